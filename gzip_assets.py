@@ -0,0 +1,81 @@
+import gzip
+import hashlib
+import os
+import shutil
+import sys
+
+# Builds the LittleFS image from a compressed copy of data/: text assets are
+# stored gzipped, and /assets.txt lists every file with its content
+# fingerprint so the web server can answer ETag revalidation from RAM.
+#
+# Runs as a PlatformIO pre-script (buildfs/uploadfs pick up the new data dir)
+# or standalone: python gzip_assets.py [data_dir] [out_dir]
+
+COMPRESSED_TYPES = {
+    ".html": "text/html",
+    ".css": "text/css",
+    ".js": "application/javascript",
+    ".json": "application/json",
+    ".svg": "image/svg+xml",
+    ".txt": "text/plain",
+}
+
+STORED_TYPES = {
+    ".png": "image/png",
+    ".jpg": "image/jpeg",
+    ".ico": "image/x-icon",
+    ".woff2": "font/woff2",
+}
+
+MANIFEST_NAME = "assets.txt"
+
+
+def build_assets(data_dir, out_dir):
+    if os.path.isdir(out_dir):
+        shutil.rmtree(out_dir)
+    os.makedirs(out_dir)
+
+    lines = []
+    for root, _, files in os.walk(data_dir):
+        for name in sorted(files):
+            src = os.path.join(root, name)
+            rel = os.path.relpath(src, data_dir).replace(os.sep, "/")
+            ext = os.path.splitext(name)[1].lower()
+            with open(src, "rb") as f:
+                content = f.read()
+
+            dst = os.path.join(out_dir, rel)
+            os.makedirs(os.path.dirname(dst), exist_ok=True)
+            if ext in COMPRESSED_TYPES:
+                # mtime=0 keeps the image byte-identical between builds
+                with open(dst + ".gz", "wb") as f:
+                    f.write(gzip.compress(content, 9, mtime=0))
+                gz = 1
+                content_type = COMPRESSED_TYPES[ext]
+            else:
+                shutil.copyfile(src, dst)
+                gz = 0
+                content_type = STORED_TYPES.get(ext)
+                if content_type is None:
+                    continue
+
+            fingerprint = hashlib.sha256(content).hexdigest()[:16]
+            lines.append("/%s %s %d %s" % (rel, fingerprint, gz, content_type))
+
+    with open(os.path.join(out_dir, MANIFEST_NAME), "w") as f:
+        f.write("\n".join(lines) + "\n")
+    return lines
+
+
+if __name__ == "__main__":
+    data_dir = sys.argv[1] if len(sys.argv) > 1 else "data"
+    out_dir = sys.argv[2] if len(sys.argv) > 2 else os.path.join(".pio", "data_gz")
+    for line in build_assets(data_dir, out_dir):
+        print(line)
+else:
+    Import("env")  # noqa: F821 (provided by PlatformIO)
+
+    project_data_dir = env.subst("$PROJECT_DATA_DIR")  # noqa: F821
+    out_dir = os.path.join(env.subst("$BUILD_DIR"), "data_gz")  # noqa: F821
+    build_assets(project_data_dir, out_dir)
+    env.Replace(PROJECT_DATA_DIR=out_dir)  # noqa: F821
@@ -2,6 +2,8 @@
 #define ACCESS_CONTROL_H
 
 #include <string>
+#include "Credential.h"
+#include "CredentialIndex.h"
 
 enum class AccessType {
     DENIED,
@@ -11,6 +13,8 @@ enum class AccessType {
 
 class AccessControl {
 public:
+    static AccessType evaluate(const Credential& credential, const CredentialIndex& credentials, const char** labelOut = nullptr);
+    static AccessType evaluate(const char* scannedCode, const CredentialIndex& credentials, const char** labelOut = nullptr);
     static AccessType evaluate(const char* scannedCode, const char* ownerCodesJson, const char* deliveryCodesJson, std::string* labelOut = nullptr);
 };
 
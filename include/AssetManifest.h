@@ -0,0 +1,35 @@
+#ifndef ASSET_MANIFEST_H
+#define ASSET_MANIFEST_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// One static file of the web UI as listed in /assets.txt by gzip_assets.py.
+// A gzipped asset is stored on flash as path + ".gz".
+struct Asset {
+    std::string path;
+    std::string etag;         // quoted strong ETag built from the content fingerprint
+    std::string contentType;
+    bool gzipped;
+};
+
+// In-memory copy of the asset manifest, so ETag revalidation and 304s are
+// answered without touching the filesystem.
+class AssetManifest {
+public:
+    // Lines of "<path> <fingerprint> <gzip 0|1> <content type>"; malformed lines are skipped
+    size_t parse(const char* text);
+    void clear() { _assets.clear(); }
+    const Asset* find(const char* path) const;
+    size_t size() const { return _assets.size(); }
+
+    // True if an If-None-Match header value (a list, "*" or weak tags) covers etag
+    static bool etagMatches(const char* ifNoneMatch, const std::string& etag);
+
+private:
+    std::vector<Asset> _assets;
+};
+
+#endif
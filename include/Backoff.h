@@ -0,0 +1,24 @@
+#ifndef BACKOFF_H
+#define BACKOFF_H
+
+#include <cstdint>
+
+// Exponential backoff with +/- jitter for reconnect loops. The caller passes
+// the randomness in (esp_random() on the device) so the sequence is testable.
+class Backoff {
+public:
+    Backoff(uint32_t initialMs, uint32_t maxMs, uint8_t jitterPercent = 20);
+
+    // Delay before the next attempt after a failure; doubles up to maxMs
+    uint32_t next(uint32_t random);
+    void reset() { _failures = 0; }
+    uint16_t failures() const { return _failures; }
+
+private:
+    uint32_t _initialMs;
+    uint32_t _maxMs;
+    uint8_t _jitterPercent;
+    uint16_t _failures = 0;
+};
+
+#endif
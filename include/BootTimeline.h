@@ -0,0 +1,33 @@
+#ifndef BOOT_TIMELINE_H
+#define BOOT_TIMELINE_H
+
+#include <Arduino.h>
+
+enum class BootPhase : uint8_t {
+    CONFIG_LOADED,
+    HARDWARE_READY,
+    LOCK_ONLINE,
+    WEB_SERVER_STARTED,
+    WIFI_CONNECTED,
+    SOFTAP_STARTED,
+    MQTT_CONNECTED,
+    COUNT
+};
+
+// millis() at which each boot phase was first reached, for /diagnostics
+class BootTimeline {
+public:
+    void mark(BootPhase phase);
+    bool reached(BootPhase phase) const { return _reached & (1u << static_cast<uint8_t>(phase)); }
+    uint32_t reachedMask() const { return _reached; }
+    uint32_t at(BootPhase phase) const { return _at[static_cast<uint8_t>(phase)]; }
+    static const char* name(BootPhase phase);
+
+private:
+    uint32_t _at[static_cast<uint8_t>(BootPhase::COUNT)] = {};
+    volatile uint32_t _reached = 0;
+};
+
+extern BootTimeline bootTimeline;
+
+#endif
@@ -0,0 +1,45 @@
+#ifndef CERT_STORE_H
+#define CERT_STORE_H
+
+#include <Arduino.h>
+#include <memory>
+#include <string>
+#include <mbedtls/x509_crt.h>
+
+enum class CertId : uint8_t {
+    MQTT_CA,
+    CALLBACK_CA,
+    COUNT
+};
+
+// CA certificates kept in RAM. Each PEM file is read and parsed once at boot
+// and again only when save() replaces it; TLS clients and /api/certs use the
+// cached copies. Handed-out pointers stay valid after a save, so a client
+// can keep the PEM it was configured with for as long as it lives.
+class CertStore {
+public:
+    void begin();
+    // Writes the PEM if it differs from the cached one; returns true if it changed
+    bool save(CertId id, const String& pem);
+
+    // Empty string if no certificate is stored
+    std::shared_ptr<const std::string> pem(CertId id);
+    // Parsed chain, nullptr if the PEM is empty or does not parse
+    std::shared_ptr<const mbedtls_x509_crt> chain(CertId id);
+    static const char* path(CertId id);
+
+private:
+    struct Entry {
+        std::shared_ptr<const std::string> pem;
+        std::shared_ptr<const mbedtls_x509_crt> chain;
+    };
+
+    void assign(CertId id, std::string&& pem);
+
+    SemaphoreHandle_t _mutex = nullptr;
+    Entry _entries[static_cast<uint8_t>(CertId::COUNT)];
+};
+
+extern CertStore certStore;
+
+#endif
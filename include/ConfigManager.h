@@ -2,23 +2,131 @@
 #define CONFIG_MANAGER_H
 
 #include "config.h"
+#include <memory>
+#include "CredentialIndex.h"
+#include "CredentialStore.h"
+#include "OneTimeCodeStore.h"
+
+enum class CredentialUpdate {
+    APPLIED,
+    NOT_FOUND,
+    STORAGE_ERROR
+};
+
+// Groups of settings handed to change listeners
+enum ConfigChange : uint32_t {
+    CONFIG_WIFI     = 1 << 0,
+    CONFIG_MQTT     = 1 << 1,
+    CONFIG_MOTOR    = 1 << 2,
+    CONFIG_MELODY   = 1 << 3,
+    CONFIG_CALLBACK = 1 << 4,
+    CONFIG_ACCESS   = 1 << 5
+};
+
+typedef void (*ConfigListener)(uint32_t changes);
 
 class ConfigManager {
 public:
     ConfigManager();
     void begin();
     void load();
+    // Schedules a write-behind of the keys that changed; flush() writes them now
     void save();
+    bool flush();
     void factoryReset();
+
+    // Stores next, saves it and notifies the listeners of the groups that differ.
+    // Returns the ConfigChange mask.
+    uint32_t update(const Config& next);
+    void addListener(uint32_t mask, ConfigListener listener);
+    void notify(uint32_t changes);
     
+    // Code lists, kept in the binary credential file. Owner and delivery codes are
+    // only edited one at a time and listed page by page through getCredentials().
+    bool setOneTimeCodes(const char* oneTimeCodesJson);
+    String getOneTimeCodesJson() const;
+    // Single owner/delivery code edits, applied live and journaled; safe from any task
+    CredentialUpdate addCredential(CredentialGroup group, const char* code, const char* label);
+    CredentialUpdate removeCredential(CredentialGroup group, const char* code);
+
     // One-time code logic
-    bool checkAndRedeemOneTimeCode(const char* scannedCode, String& labelOut);
+    // Copies the label of a redeemed code to labelOut, since the list may be replaced right after
+    bool checkAndRedeemOneTimeCode(const Credential& credential, char* labelOut, size_t labelSize);
     void resetDeliveryBlockIfNeeded(const char* requester);
     
     Config& getConfig() { return _config; }
+    uint32_t nvsWritesTotal() const { return _nvsWritesTotal; }
+    uint32_t nvsWritesSinceBoot() const { return _nvsWritesBoot; }
+    uint32_t flushCount() const { return _flushCount; }
+    bool hasPendingWrites() const { return _dirty; }
+    unsigned long configLoadMicros() const { return _configLoadMicros; }
+    // State of the credential file at boot; a damaged one is kept as <path>.bad
+    CredentialFileStatus credentialFileStatus() const { return _credentialFileStatus; }
+    bool credentialsQuarantined() const { return _credentialsQuarantined; }
+    // Owner and delivery codes as an immutable snapshot. Edits publish a new
+    // index, so whatever a holder reads, including label pointers, stays valid
+    // for as long as it keeps the pointer.
+    std::shared_ptr<const CredentialIndex> getCredentials() const;
 
 private:
+    static void persistTask(void* param);
+    void publishCredentials(std::shared_ptr<const CredentialIndex> credentials);
+    void lockCredentials() const;
+    void unlockCredentials() const;
+    // Folds the journals into the credential file on the persistence task
+    void requestCompaction();
+    void compactIfRequested();
+    void compactOneTimeCodes();
+    bool loadSnapshot();
+    void loadLegacyKeys();
+    void removeLegacyKeys();
+    void loadCredentials();
+    void migrateLegacyCodes();
+    void quarantineCredentials();
+    bool persistCredentials();
+    void replayRedemptionLog();
+    CredentialUpdate changeCredential(uint8_t op, CredentialGroup group, const char* code, const char* label);
+    void compactCredentialJournal();
+    void appendRedemption(const RedemptionRecord& record);
+
+    // Redemptions and credential edits are journaled and folded into the credential file every COMPACT_AFTER entries
+    static const uint16_t COMPACT_AFTER = 32;
+
+    static const uint8_t MAX_LISTENERS = 8;
+    static const uint32_t COALESCE_MS = 2000;
+    static const uint32_t MAX_COALESCE_MS = 10000;
+    static const uint32_t RETRY_MS = 5000;
+
     Config _config;
+    // Last values written to NVS; flush() skips the write when nothing differs
+    Config _persisted;
+    bool _persistedDeliveryBlocked = false;
+    volatile bool _dirty = false;
+    TaskHandle_t _persistTask = nullptr;
+    SemaphoreHandle_t _persistMutex = nullptr;
+    // Held for every change of the code lists and every write of the credential
+    // file and its journals, whichever task (web server, MQTT, Wiegand, persistence) makes it
+    SemaphoreHandle_t _credentialMutex = nullptr;
+    volatile bool _compactRequested = false;
+    uint32_t _nvsWritesTotal = 0;
+    uint32_t _nvsWritesBoot = 0;
+    uint32_t _flushCount = 0;
+    uint32_t _sequence = 0;
+    uint8_t _activeSlot = 1;
+    unsigned long _configLoadMicros = 0;
+    struct {
+        uint32_t mask;
+        ConfigListener listener;
+    } _listeners[MAX_LISTENERS];
+    uint8_t _listenerCount = 0;
+    // Written with _credentialMutex held; _snapshotMutex only covers the pointer copy
+    std::shared_ptr<const CredentialIndex> _credentials;
+    SemaphoreHandle_t _snapshotMutex = nullptr;
+    OneTimeCodeStore _oneTimeCodes;
+    uint16_t _pendingRedemptions = 0;
+    uint16_t _pendingCredentialChanges = 0;
+    CredentialFileStatus _credentialFileStatus = CredentialFileStatus::MISSING;
+    bool _credentialsQuarantined = false;
 };
 
 extern ConfigManager configManager;
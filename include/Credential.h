@@ -0,0 +1,48 @@
+#ifndef CREDENTIAL_H
+#define CREDENTIAL_H
+
+#include <cstddef>
+#include <cstdint>
+
+// Canonical form of a scanned credential, produced by WiegandDecoder and
+// matched against the CredentialIndex as an integer.
+//
+// 26- and 34-bit cards carry a facility code above a 16-bit card number.
+// Keypad PINs (4/8-bit frames) store their digits as nibbles, so PIN 123456
+// has the value 0x123456 - the same value a stored code "123456" is keyed by.
+// They also keep the number of digits typed, as "0815" and "815" have the
+// same value but are different PINs.
+struct Credential {
+    uint8_t bits;
+    uint8_t digits;     // keypad PINs only, 0 for cards
+    uint32_t facility;
+    uint64_t cardNumber;
+
+    bool isValid() const { return bits != 0; }
+    bool isKeypad() const { return bits == 4 || bits == 8; }
+
+    uint64_t value() const {
+        if (hasFacility(bits)) {
+            return (static_cast<uint64_t>(facility) << 16) | cardNumber;
+        }
+        return cardNumber;
+    }
+
+    static Credential fromValue(uint64_t value, uint8_t bits, uint8_t digits = 0) {
+        Credential credential;
+        credential.bits = bits;
+        credential.digits = digits;
+        if (hasFacility(bits)) {
+            credential.facility = static_cast<uint32_t>(value >> 16);
+            credential.cardNumber = value & 0xFFFF;
+        } else {
+            credential.facility = 0;
+            credential.cardNumber = value;
+        }
+        return credential;
+    }
+
+    static bool hasFacility(uint8_t bits) { return bits == 26 || bits == 34; }
+};
+
+#endif
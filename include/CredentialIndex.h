@@ -0,0 +1,101 @@
+#ifndef CREDENTIAL_INDEX_H
+#define CREDENTIAL_INDEX_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+enum class CredentialGroup : uint8_t {
+    OWNER = 0,
+    DELIVERY = 1,
+    ONE_TIME = 2
+};
+
+// One stored code. Numeric codes are keyed by their hex value plus the number
+// of leading zeros they were written with (flags, ZEROS_MASK), anything else
+// by a 64-bit FNV-1a hash of the code text (FLAG_TEXT set). Text codes keep
+// "<label>\0<code>\0" in the label pool so they can be listed again.
+// The layout is also the on-flash record format of CredentialStore.
+struct CredentialRecord {
+    uint64_t key;
+    uint32_t label;   // offset into the label pool, NO_LABEL if none
+    uint8_t group;    // CredentialGroup
+    uint8_t flags;
+    uint16_t slot;    // position of the code in its source list
+};
+
+// Sorted lookup table compiled from the JSON code lists. Built once whenever
+// the configuration changes so a scan is a binary search without allocations.
+class CredentialIndex {
+public:
+    static const uint8_t FLAG_TEXT = 0x01;
+    static const uint8_t FLAG_REDEEMED = 0x02;
+    // Leading zeros of a numeric code, so "0815" only matches a PIN typed as 0815
+    static const uint8_t ZEROS_MASK = 0xF0;
+    static const uint8_t ZEROS_SHIFT = 4;
+    // Flags that are part of the key; state flags such as FLAG_REDEEMED are not
+    static const uint8_t KEY_FLAGS = FLAG_TEXT | ZEROS_MASK;
+    static const uint32_t NO_LABEL = 0xFFFFFFFF;
+
+    void clear();
+    bool addJson(const char* codesJson, CredentialGroup group);
+    void add(const char* code, const char* label, CredentialGroup group, uint16_t slot);
+    void finalize();
+
+    // Live edits on a finalized index; keep the sort order. upsert replaces the
+    // label of an existing code in the same group and returns true if the code is new.
+    bool upsert(const char* code, const char* label, CredentialGroup group);
+    bool erase(const char* code, CredentialGroup group);
+    // Drops labels left behind by edits
+    void compactLabels();
+    // Copies source without the labels left behind by its edits, with room for
+    // one more record and spareLabelBytes so the next edit does not reallocate
+    void assignCompacted(const CredentialIndex& source, size_t spareLabelBytes);
+
+    // Matches the scanned value against stored codes written either in hex or
+    // in decimal. Owner codes win over delivery codes for the same value.
+    // digits is the length of a typed PIN; only a stored code written with as
+    // many digits matches directly. 0 (cards) means no leading zeros.
+    const CredentialRecord* find(uint64_t value, uint8_t digits = 0) const;
+    const CredentialRecord* findText(const char* code) const;
+    const CredentialRecord* findScanned(const char* scannedCode) const;
+
+    const char* label(const CredentialRecord& record) const;
+    // Writes the code as it can be entered again: hex for numeric codes, the original text otherwise
+    void codeText(const CredentialRecord& record, char* out, size_t size) const;
+    size_t size() const { return _records.size(); }
+    size_t count(CredentialGroup group) const;
+    // Position of the first record not ordered before probe (after it if inclusive is false)
+    size_t position(const CredentialRecord& probe, bool inclusive) const;
+
+    // Raw access for CredentialStore and OneTimeCodeStore
+    const std::vector<CredentialRecord>& records() const { return _records; }
+    std::vector<CredentialRecord>& records() { return _records; }
+    const std::vector<char>& labels() const { return _labels; }
+    void assign(std::vector<CredentialRecord>&& records, std::vector<char>&& labels);
+
+    // Serializes the records of one group as a JSON array in list order. One-time
+    // codes take their redeemed state from redeemedBySlot when given.
+    void toJson(CredentialGroup group, std::string& out, const std::vector<bool>* redeemedBySlot = nullptr) const;
+
+    static bool parseHex(const char* text, uint64_t& value);
+    static bool decimalSpelling(uint64_t value, uint64_t& spelledAsHex);
+    static uint64_t hashText(const char* text);
+    // Key and KEY_FLAGS bits a code is stored under
+    static uint8_t keyFor(const char* code, uint64_t& key);
+    static uint8_t hexDigits(uint64_t value);
+
+private:
+    const CredentialRecord* findKey(uint64_t key, uint8_t flags) const;
+    uint32_t internLabel(const char* label);
+    void relinkLabels(const std::vector<char>& old);
+    uint32_t appendText(const char* label, const char* code);
+
+    std::vector<CredentialRecord> _records;
+    std::vector<char> _labels;
+    std::unordered_map<std::string, uint32_t> _labelLookup; // only populated while building
+};
+
+#endif
@@ -0,0 +1,84 @@
+#ifndef CREDENTIAL_STORE_H
+#define CREDENTIAL_STORE_H
+
+#include "CredentialIndex.h"
+#include "OneTimeCodeStore.h"
+#include "Storage.h"
+
+// Versioned binary credential file on LittleFS:
+//
+//   CredentialFileHeader
+//   access records    (accessCount x CredentialRecord, sorted)
+//   access labels     (accessLabelBytes)
+//   one-time records  (oneTimeCount x CredentialRecord, sorted)
+//   one-time labels   (oneTimeLabelBytes)
+//
+// The records are loaded straight into CredentialIndex without parsing, so
+// boot time grows with a single sequential read rather than a JSON parse.
+// All file access goes through a Storage, so the format is tested natively.
+struct CredentialFileHeader {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t recordSize;
+    uint32_t oneTimeListId;
+    uint32_t accessCount;
+    uint32_t accessLabelBytes;
+    uint32_t oneTimeCount;
+    uint32_t oneTimeLabelBytes;
+    uint32_t crc;               // CRC-32 of the header up to this field and everything after it
+};
+
+// Entry of the change journal next to the credential file, followed by the
+// code and label bytes (without terminators). Replayed on top of the file at boot.
+struct CredentialChange {
+    uint8_t op;
+    uint8_t group;          // CredentialGroup
+    uint8_t codeLength;
+    uint8_t labelLength;
+};
+
+enum class CredentialFileStatus : uint8_t {
+    OK,
+    MISSING,
+    CORRUPT,        // no valid header, size mismatch or CRC mismatch
+    UNSUPPORTED     // version or record size of another firmware
+};
+
+class CredentialStore {
+public:
+    static const uint32_t MAGIC = 0x52434B50; // "PKCR"
+    static const uint16_t VERSION = 1;
+    static const uint8_t CHANGE_UPSERT = 1;
+    static const uint8_t CHANGE_ERASE = 2;
+    static const size_t MAX_CODE_LENGTH = 32;
+    static const size_t MAX_LABEL_LENGTH = 64;
+    // Per section; slots are 16 bits
+    static const uint32_t MAX_RECORDS = 0x10000;
+    static const uint32_t MAX_LABEL_BYTES = MAX_RECORDS * (MAX_LABEL_LENGTH + 1);
+
+    // Leaves access and oneTime untouched unless the file is OK
+    static CredentialFileStatus load(Storage& storage, const char* path, CredentialIndex& access, CredentialIndex& oneTime, uint32_t& oneTimeListId);
+    static const char* statusName(CredentialFileStatus status);
+    // Writes to a temporary file and renames it over path, so a power loss leaves the old file intact.
+    static bool save(Storage& storage, const char* path, const CredentialIndex& access, const CredentialIndex& oneTime, uint32_t oneTimeListId);
+    // Rewrites single one-time records plus the header CRC without touching the
+    // rest of the file. The access section and the CRC are taken from the file,
+    // which may not hold the journaled edits yet. Returns false, leaving the
+    // file as it was, if it does not hold this one-time list or fails its CRC.
+    static bool updateOneTimeRecords(Storage& storage, const char* path, const CredentialIndex& oneTime, uint32_t oneTimeListId, const std::vector<size_t>& positions);
+
+    static bool appendChange(Storage& storage, const char* journalPath, uint8_t op, CredentialGroup group, const char* code, const char* label);
+    // Applies the journal to access and returns the number of entries replayed
+    static size_t replayChanges(Storage& storage, const char* journalPath, CredentialIndex& access);
+    static bool applyChange(CredentialIndex& access, uint8_t op, CredentialGroup group, const char* code, const char* label);
+
+    // Append-only log of one-time code redemptions, folded into the file by updateOneTimeRecords
+    static bool appendRedemption(Storage& storage, const char* logPath, const RedemptionRecord& record);
+    // Applies the log to oneTime and returns the number of records that belonged to its list
+    static size_t replayRedemptions(Storage& storage, const char* logPath, OneTimeCodeStore& oneTime);
+
+private:
+    static CredentialFileHeader headerFor(const CredentialIndex& access, const CredentialIndex& oneTime, uint32_t oneTimeListId);
+};
+
+#endif
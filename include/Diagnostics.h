@@ -0,0 +1,98 @@
+#ifndef DIAGNOSTICS_H
+#define DIAGNOSTICS_H
+
+#include <Arduino.h>
+#include <memory>
+#include <string>
+#include "EventStream.h"
+
+// Everything /diagnostics reports, as plain values so a change is one memcmp
+struct DiagnosticsState {
+    LiveState live;
+    uint32_t nvsWritesTotal;
+    uint32_t nvsWritesBoot;
+    uint32_t configFlushes;
+    uint32_t configLoadUs;
+    bool configPending;
+    uint8_t credentialFileStatus;
+    bool credentialsQuarantined;
+    bool wifiSoftApActive;
+    uint8_t wifiState;
+    uint8_t wifiChannel;
+    int8_t wifiRssi;
+    uint8_t wifiBssid[6];
+    uint8_t mqttState;
+    uint32_t wifiReconnects;
+    uint32_t wifiLastReconnectMs;
+    uint32_t wifiMaxReconnectMs;
+    uint32_t wifiFastConnects;
+    uint32_t wifiFailedAttempts;
+    uint32_t assetResponses;
+    uint32_t assetNotModified;
+    uint32_t eventClients;
+    uint32_t eventsSent;
+    uint32_t webhookQueueDepth;
+    uint32_t webhookDelivered;
+    uint32_t webhookFailed;
+    uint32_t webhookDropped;
+    uint32_t webhookRetries;
+    uint32_t webhookLastLatencyMs;
+    uint32_t webhookMaxLatencyMs;
+    uint32_t mqttQueueDepth;
+    uint32_t mqttQueueHighWater;
+    uint32_t mqttQueueDropped;
+    uint32_t mqttConnects;
+    uint32_t mqttConnectFailures;
+    uint32_t mqttLastConnectMs;
+    uint32_t mqttMaxConnectMs;
+    uint32_t mqttJournalPending;
+    uint32_t mqttJournalDropped;
+    uint32_t mqttReplayed;
+    uint32_t bootPhasesReached;
+    uint32_t heapFree;
+    uint32_t heapMinFree;
+    uint32_t heapLargestBlock;
+    uint32_t heapLargestBlockMin;
+    uint32_t heapSamples;
+    uint32_t wifiScanGeneration;
+};
+
+// The /diagnostics document, kept up to date by update() and serialized at
+// most once per generation. Requests share the serialized snapshot, and the
+// generation is the ETag, so an unchanged box answers with a 304.
+class Diagnostics {
+public:
+    void begin();
+    // Called periodically; bumps the generation when any value moved
+    void update();
+
+    uint32_t generation() const { return _generation; }
+    // Quoted ETag of the current generation
+    void etag(char* out, size_t size) const;
+    // Serialized document of the current generation, shared with in-flight
+    // responses; writes the matching ETag
+    std::shared_ptr<const std::string> snapshot(char* etagOut, size_t size);
+
+private:
+    DiagnosticsState capture(unsigned long now);
+    void consumeWifiScan();
+    std::string serialize(const DiagnosticsState& state) const;
+    void formatEtag(uint32_t generation, char* out, size_t size) const;
+
+    // Heap and RSSI move constantly; sampling them rarely keeps the ETag stable
+    static const unsigned long SLOW_SAMPLE_MS = 5000;
+
+    SemaphoreHandle_t _mutex = nullptr;
+    DiagnosticsState _state = {};
+    volatile uint32_t _generation = 0;
+    uint32_t _bootId = 0;
+    unsigned long _lastSlowSample = 0;
+    std::string _wifiNetworksJson = "[]";
+    uint32_t _wifiScanGeneration = 0;
+    std::shared_ptr<const std::string> _snapshot;
+    uint32_t _snapshotGeneration = UINT32_MAX;
+};
+
+extern Diagnostics diagnostics;
+
+#endif
@@ -0,0 +1,57 @@
+#ifndef EVENT_JOURNAL_H
+#define EVENT_JOURNAL_H
+
+#include <Arduino.h>
+#include "MqttOutbox.h"
+
+// Entry of the outbound event journal, followed by length payload bytes
+struct JournalEntry {
+    uint32_t seq;
+    uint8_t kind;           // MqttTopic
+    uint8_t reserved;
+    uint16_t length;
+    uint32_t crc;           // CRC-32 of the fields above and the payload
+};
+
+// Append-only store-and-forward journal for MQTT messages that could not be
+// published. Two segment files of at most SEGMENT_BYTES each bound the flash
+// use: when the newer one is full the older one is dropped. A segment is
+// deleted once it has been replayed, so a restart in the middle of a replay
+// sends that segment again (at least once, never lost).
+class EventJournal : public MqttSpool {
+public:
+    static const size_t SEGMENT_BYTES = 8192;
+
+    // Scans the segments left from before a restart
+    void begin();
+    bool append(uint8_t kind, const char* data, size_t length) override;
+    bool peek(MqttOutbox::Message& out) override;
+    void consume() override;
+
+    bool empty() const override { return pending() == 0; }
+    uint32_t pending() const { return _segments[0].entries + _segments[1].entries; }
+    uint32_t dropped() const { return _dropped; }
+    uint32_t nextSeq() const { return _nextSeq; }
+
+private:
+    struct Segment {
+        uint32_t entries;   // not yet replayed
+        uint32_t bytes;     // file size
+    };
+
+    static const char* segmentPath(uint8_t segment);
+    uint8_t oldest() const;
+    bool scan(uint8_t segment, uint32_t& firstSeq);
+    void compact(uint8_t segment, uint32_t validBytes);
+    void removeSegment(uint8_t segment);
+
+    Segment _segments[2] = {};
+    uint8_t _active = 0;
+    // Read position in the oldest segment and size of the entry last peeked
+    uint32_t _readOffset = 0;
+    uint32_t _peekedBytes = 0;
+    uint32_t _nextSeq = 0;
+    uint32_t _dropped = 0;
+};
+
+#endif
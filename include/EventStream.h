@@ -0,0 +1,51 @@
+#ifndef EVENT_STREAM_H
+#define EVENT_STREAM_H
+
+#include <ESPAsyncWebServer.h>
+#include "state.h"
+
+// The values the dashboard shows live. Field names on the wire match /diagnostics.
+struct LiveState {
+    MailboxState mailboxState;
+    bool closedSwitch;
+    bool parcelSwitch;
+    bool mailSwitch;
+    bool deliveryBlocked;
+    bool oneTimeOpening;
+    bool wifiScanRunning;
+    bool calibrationActive;
+    int calibrationStep;
+    int calibrationCandidate;
+    uint64_t scannedValue;
+    uint64_t keypadValue;
+    uint8_t keypadDigits;       // 0 until a PIN was entered
+    uint32_t scanCount;
+};
+
+// Server-sent events on /events. A newly connected client gets the full
+// LiveState as a "state" event, then "delta" events with only the changed
+// fields. Each delta is serialized once and queued to every client. The
+// sampling task also keeps the Diagnostics snapshot current.
+class EventStream {
+public:
+    void begin(AsyncWebServer& server);
+    size_t clientCount() { return _events.count(); }
+    uint32_t eventsSent() const { return _eventsSent; }
+    static LiveState capture();
+
+private:
+    static void streamTask(void* param);
+    void update();
+    static size_t serialize(const LiveState& state, const LiveState* previous, char* out, size_t size);
+
+    static const unsigned long POLL_INTERVAL_MS = 20;
+
+    AsyncEventSource _events{"/events"};
+    LiveState _last = {};
+    uint32_t _eventId = 0;
+    uint32_t _eventsSent = 0;
+};
+
+extern EventStream eventStream;
+
+#endif
@@ -0,0 +1,36 @@
+#ifndef HEAP_MONITOR_H
+#define HEAP_MONITOR_H
+
+#include <Arduino.h>
+
+// Samples the largest free heap block periodically. A shrinking block while
+// free heap stays flat means fragmentation, which first shows up as failing
+// TLS handshakes (they need one ~16 KB contiguous allocation).
+class HeapMonitor {
+public:
+    static const uint8_t HISTORY_SIZE = 24;
+    static const unsigned long SAMPLE_INTERVAL_MS = 5UL * 60UL * 1000UL;
+
+    void begin();
+    void update();
+
+    uint32_t largestFreeBlock() const;
+    uint32_t lowestLargestFreeBlock() const { return _lowest; }
+    uint32_t sampleCount() const { return _sampleCount; }
+    // Copies the samples oldest first and returns their number
+    uint8_t history(uint32_t* out, uint8_t maxSamples) const;
+
+private:
+    void sample();
+
+    uint32_t _samples[HISTORY_SIZE];
+    uint8_t _next = 0;
+    uint8_t _count = 0;
+    uint32_t _lowest = UINT32_MAX;
+    uint32_t _sampleCount = 0;
+    unsigned long _lastSample = 0;
+};
+
+extern HeapMonitor heapMonitor;
+
+#endif
@@ -0,0 +1,17 @@
+#ifndef LITTLE_FS_STORAGE_H
+#define LITTLE_FS_STORAGE_H
+
+#include "Storage.h"
+
+// Storage on the LittleFS partition
+class LittleFsStorage : public Storage {
+public:
+    std::unique_ptr<StorageFile> open(const char* path, const char* mode) override;
+    bool exists(const char* path) override;
+    bool remove(const char* path) override;
+    bool rename(const char* from, const char* to) override;
+};
+
+extern LittleFsStorage littleFsStorage;
+
+#endif
@@ -2,17 +2,24 @@
 #define MAILBOX_NETWORK_MANAGER_H
 
 #include <ESPAsyncWebServer.h>
+#include "AssetManifest.h"
 
 class MailboxNetworkManager {
 public:
     MailboxNetworkManager();
     void begin();
+    uint32_t assetResponses() const { return _assetResponses; }
+    uint32_t assetNotModified() const { return _assetNotModified; }
 
 private:
     void setupWebServer();
-    void connectWiFi();
+    void loadAssetManifest();
+    void serveAsset(AsyncWebServerRequest *request, const char* path);
 
     AsyncWebServer _server;
+    AssetManifest _assets;
+    uint32_t _assetResponses = 0;
+    uint32_t _assetNotModified = 0;
 };
 
 extern MailboxNetworkManager mailboxNetworkManager;
@@ -7,7 +7,7 @@ class MelodyPlayer {
 public:
     MelodyPlayer(int buzzerPin);
     void begin();
-    void play(const String& melodyName);
+    void play(const char* melodyName);
     void update();
     bool isPlaying() const { return _melodyPlaying; }
 
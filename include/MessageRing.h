@@ -0,0 +1,142 @@
+#ifndef MESSAGE_RING_H
+#define MESSAGE_RING_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// What push() does when the ring is full
+enum class OverflowPolicy : uint8_t {
+    DROP_NEWEST,  // the new message is rejected
+    DROP_OLDEST   // the oldest queued message makes room; the latest value always gets out
+};
+
+// One preformatted outbound message. kind is chosen by the producer (e.g. the topic).
+template <size_t MaxLength>
+struct RingMessage {
+    static const size_t CAPACITY = MaxLength;
+    uint8_t kind;
+    uint16_t length;
+    char data[MaxLength];
+};
+
+// Bounded lock-free multi-producer/multi-consumer queue of fixed-size
+// messages (Vyukov's sequence-numbered ring). Never allocates, so any task on
+// either core can push without a mutex. Capacity must be a power of two.
+template <size_t Capacity, size_t MaxLength>
+class MessageRing {
+    static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+public:
+    typedef RingMessage<MaxLength> Message;
+    // Oldest messages a single DROP_OLDEST push may discard before giving up
+    static const uint8_t MAX_DISCARDS = 4;
+
+    explicit MessageRing(OverflowPolicy policy) : _policy(policy) {
+        for (size_t i = 0; i < Capacity; ++i) {
+            _cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    // Copies data into the ring; false if it did not fit or was dropped by the policy
+    bool push(uint8_t kind, const char* data, size_t length) {
+        if (length > MaxLength) {
+            _dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        for (uint8_t discards = 0; ; ++discards) {
+            if (tryPush(kind, data, length)) {
+                _pushed.fetch_add(1, std::memory_order_relaxed);
+                updateHighWater();
+                return true;
+            }
+            // The slot can also be held by a consumer that has not released it
+            // yet; a bounded number of discards keeps that from spinning or
+            // emptying the ring, and only messages actually removed count as dropped
+            Message discarded;
+            if (_policy == OverflowPolicy::DROP_NEWEST || discards == MAX_DISCARDS || !pop(discarded)) {
+                _dropped.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+            _dropped.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    bool pop(Message& out) {
+        size_t pos = _dequeuePos.load(std::memory_order_relaxed);
+        for (;;) {
+            Cell& cell = _cells[pos & (Capacity - 1)];
+            size_t sequence = cell.sequence.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos + 1);
+            if (diff == 0) {
+                if (_dequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    out.kind = cell.message.kind;
+                    out.length = cell.message.length;
+                    memcpy(out.data, cell.message.data, cell.message.length);
+                    cell.sequence.store(pos + Capacity, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = _dequeuePos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    size_t size() const {
+        size_t enqueued = _enqueuePos.load(std::memory_order_relaxed);
+        size_t dequeued = _dequeuePos.load(std::memory_order_relaxed);
+        return enqueued >= dequeued ? enqueued - dequeued : 0;
+    }
+    static constexpr size_t capacity() { return Capacity; }
+    uint32_t pushed() const { return _pushed.load(std::memory_order_relaxed); }
+    uint32_t dropped() const { return _dropped.load(std::memory_order_relaxed); }
+    uint32_t highWater() const { return _highWater.load(std::memory_order_relaxed); }
+
+private:
+    struct Cell {
+        std::atomic<size_t> sequence;
+        Message message;
+    };
+
+    bool tryPush(uint8_t kind, const char* data, size_t length) {
+        size_t pos = _enqueuePos.load(std::memory_order_relaxed);
+        for (;;) {
+            Cell& cell = _cells[pos & (Capacity - 1)];
+            size_t sequence = cell.sequence.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+            if (diff == 0) {
+                if (_enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    cell.message.kind = kind;
+                    cell.message.length = static_cast<uint16_t>(length);
+                    memcpy(cell.message.data, data, length);
+                    cell.sequence.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = _enqueuePos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    void updateHighWater() {
+        uint32_t depth = static_cast<uint32_t>(size());
+        uint32_t seen = _highWater.load(std::memory_order_relaxed);
+        while (depth > seen && !_highWater.compare_exchange_weak(seen, depth, std::memory_order_relaxed)) {
+        }
+    }
+
+    const OverflowPolicy _policy;
+    Cell _cells[Capacity];
+    std::atomic<size_t> _enqueuePos{0};
+    std::atomic<size_t> _dequeuePos{0};
+    std::atomic<uint32_t> _pushed{0};
+    std::atomic<uint32_t> _dropped{0};
+    std::atomic<uint32_t> _highWater{0};
+};
+
+#endif
@@ -0,0 +1,62 @@
+#ifndef MQTT_COMMAND_H
+#define MQTT_COMMAND_H
+
+#include <cstddef>
+#include <cstdint>
+
+enum class MqttCommandAction : uint8_t {
+    NONE,
+    OPEN,          // compartment: "parcel" or "mail"
+    CALIBRATE,
+    PLAY_MELODY,   // melody
+    ADD_CODE,      // group, code, label
+    REVOKE_CODE,   // group, code
+    GET_STATE
+};
+
+enum class PayloadFormat : uint8_t {
+    TEXT,          // the plain OPEN_PARCEL / OPEN_MAIL words of earlier firmware
+    JSON,
+    MSGPACK
+};
+
+// Slice of the payload buffer, not terminated
+struct PayloadView {
+    const char* data = nullptr;
+    size_t length = 0;
+
+    bool empty() const { return length == 0; }
+    bool equals(const char* text) const;
+    // Copies the slice with a terminator; false if it does not fit
+    bool copyTo(char* out, size_t size) const;
+};
+
+struct MqttCommand {
+    MqttCommandAction action = MqttCommandAction::NONE;
+    PayloadFormat format = PayloadFormat::TEXT;
+    PayloadView id;           // correlation id, echoed in the response
+    PayloadView compartment;
+    PayloadView melody;
+    PayloadView group;        // "owner" or "delivery"
+    PayloadView code;
+    PayloadView label;
+};
+
+const size_t MQTT_COMMAND_MAX_ID = 40;
+
+// Parses a command in place: JSON escapes are decoded inside payload and all
+// views point into it, so nothing is allocated. Takes a flat JSON object or
+// MessagePack map with string values ({"cmd":"open","compartment":"parcel",
+// "id":"42"}) or one of the plain words OPEN_PARCEL / OPEN_MAIL. Returns an
+// error message or nullptr; format and id are filled in whenever they could
+// be read, so a rejected command can still be answered.
+const char* parseMqttCommand(char* payload, size_t length, MqttCommand& out);
+
+const char* mqttCommandName(MqttCommandAction action);
+
+// Response in the encoding of the command (MessagePack for MessagePack, JSON
+// otherwise): id, cmd, ok, error if any and state if given. Returns the
+// length, 0 if it does not fit.
+size_t formatMqttResponse(char* out, size_t size, const MqttCommand& command, const char* error, const char* state);
+
+#endif
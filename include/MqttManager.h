@@ -5,8 +5,17 @@
 #include <WiFi.h>
 #include <WiFiClientSecure.h>
 #include <PubSubClient.h>
+#include <memory>
+#include <string>
+#include "EventJournal.h"
+#include "MqttSession.h"
 
-class MqttManager {
+// Device side of the MQTT session: keeps the broker connection on mqttTask
+// without ever blocking it in a handshake. The TCP/TLS connect runs on a
+// low-priority helper task, only the short MQTT CONNECT exchange runs here.
+// Backoff, ordering and replay live in MqttSession; messages that cannot be
+// published go to an EventJournal on LittleFS.
+class MqttManager : public MqttLink {
 public:
     MqttManager();
     ~MqttManager();
@@ -14,13 +23,51 @@ public:
     void update();
     bool isConnected();
     void publish(const char* topic, const char* payload);
+    // Rebuilds the client with the current broker settings on the next update()
+    void requestReconfigure() { _reconfigureRequested = true; }
+
+    MqttState state() const { return _session.state(); }
+    uint32_t connects() const { return _session.connects(); }
+    uint32_t connectFailures() const { return _session.connectFailures(); }
+    uint32_t lastConnectMs() const { return _session.lastConnectMs(); }
+    uint32_t maxConnectMs() const { return _session.maxConnectMs(); }
+    uint32_t journalPending() const { return _journal.pending(); }
+    uint32_t journalDropped() const { return _journal.dropped() + _session.lost(); }
+    uint32_t replayed() const { return _session.replayed(); }
 
 private:
-    void handleQueue();
-    void reconnect();
+    static void connectTask(void* param);
+    void setupClient();
+    void publishSchema();
+
+    bool networkUp() override;
+    void beginConnect() override;
+    int connectResult() override;
+    bool handshake() override;
+    bool loop() override;
+    bool publish(const char* topic, const uint8_t* payload, size_t length) override;
+    void close() override;
+    void onAttemptStarted() override;
+    void onConnected(uint32_t connectMs) override;
+    void onAttemptFailed(uint16_t failures, uint32_t retryInMs) override;
+    void onConnectionLost() override;
 
     Client* _netClient = nullptr;
+    std::shared_ptr<const std::string> _caCert;
     PubSubClient _mqttClient;
+    void (*_callback)(char* topic, byte* payload, unsigned int length) = nullptr;
+    volatile bool _reconfigureRequested = false;
+
+    static const uint8_t HANDSHAKE_TIMEOUT_S = 10;
+    static const uint8_t SOCKET_TIMEOUT_S = 5;
+
+    TaskHandle_t _connectTask = nullptr;
+    // Written by the connect task, read once it is done
+    volatile bool _transportDone = false;
+    volatile bool _transportOk = false;
+
+    EventJournal _journal;
+    MqttSession _session{mqttOutbox, *this, &_journal};
 };
 
 extern MqttManager mqttManager;
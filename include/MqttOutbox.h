@@ -0,0 +1,42 @@
+#ifndef MQTT_OUTBOX_H
+#define MQTT_OUTBOX_H
+
+#include <cstddef>
+#include <cstdint>
+#include "MessageRing.h"
+
+// Outbound MQTT messages; pushed from any task, drained by the MQTT task.
+// A full queue drops its oldest entry so the latest state always gets out.
+enum MqttTopic : uint8_t {
+    MQTT_TOPIC_STATE,
+    MQTT_TOPIC_RESPONSE,
+    MQTT_TOPIC_STATE_MSGPACK
+};
+// Version of the message fields ("v") and of the versioned topic layout
+const uint8_t MQTT_SCHEMA_VERSION = 1;
+typedef MessageRing<16, 160> MqttOutbox;
+extern MqttOutbox mqttOutbox;
+
+inline const char* mqttTopicName(uint8_t topic) {
+    switch (topic) {
+        case MQTT_TOPIC_STATE: return "paketkasten/state";
+        case MQTT_TOPIC_RESPONSE: return "paketkasten/response";
+        case MQTT_TOPIC_STATE_MSGPACK: return "paketkasten/v1/msgpack/state";
+        default: return nullptr;
+    }
+}
+
+// Holds messages that could not be published until the broker is back
+// (EventJournal on the device)
+class MqttSpool {
+public:
+    virtual ~MqttSpool() {}
+    virtual bool append(uint8_t kind, const char* data, size_t length) = 0;
+    // Reads the oldest message without removing it
+    virtual bool peek(MqttOutbox::Message& out) = 0;
+    // Removes the message returned by the last peek()
+    virtual void consume() = 0;
+    virtual bool empty() const = 0;
+};
+
+#endif
@@ -0,0 +1,98 @@
+#ifndef MQTT_SESSION_H
+#define MQTT_SESSION_H
+
+#include <cstddef>
+#include <cstdint>
+#include "Backoff.h"
+#include "MqttOutbox.h"
+
+enum class MqttState : uint8_t {
+    DISABLED,    // no broker configured
+    WAITING,     // backing off before the next attempt, or no station link
+    CONNECTING,  // transport (and TLS) handshake running without blocking update()
+    CONNECTED
+};
+
+// The network side of an MqttSession: PubSubClient plus a connect task on the
+// device, an in-process broker stand-in in the native tests. Incoming
+// messages are delivered by loop() straight to the command handler.
+class MqttLink {
+public:
+    virtual ~MqttLink() {}
+    // Station link up; no attempt is started without it
+    virtual bool networkUp() = 0;
+    // Starts the TCP/TLS connect and returns at once
+    virtual void beginConnect() = 0;
+    // While connecting: 0 still running, 1 transport up, -1 failed
+    virtual int connectResult() = 0;
+    // MQTT CONNECT/CONNACK on a transport that is already up
+    virtual bool handshake() = 0;
+    // Services the connection and delivers incoming messages; false once it dropped
+    virtual bool loop() = 0;
+    virtual bool publish(const char* topic, const uint8_t* payload, size_t length) = 0;
+    // Drops the transport after a failed attempt or a lost connection
+    virtual void close() = 0;
+
+    // Notifications, e.g. for logging; onConnected also subscribes
+    virtual void onAttemptStarted() {}
+    virtual void onConnected(uint32_t connectMs) { (void)connectMs; }
+    virtual void onAttemptFailed(uint16_t failures, uint32_t retryInMs) { (void)failures; (void)retryInMs; }
+    virtual void onConnectionLost() {}
+};
+
+// Broker connection state machine and outbound path, free of Arduino and
+// FreeRTOS so it builds in the native env. The caller passes the time and
+// the randomness for the backoff jitter. Messages go from the outbox to the
+// broker; while that is not possible they go to the spool and are replayed
+// in order, REPLAY_BATCH per REPLAY_INTERVAL_MS, once connected. Without a
+// spool they wait in the outbox.
+class MqttSession {
+public:
+    static const uint8_t REPLAY_BATCH = 5;
+    static const uint32_t REPLAY_INTERVAL_MS = 100;
+
+    MqttSession(MqttOutbox& outbox, MqttLink& link, MqttSpool* spool = nullptr);
+
+    // DISABLED, or WAITING with the first attempt due at once
+    void reset(bool enabled, uint32_t now);
+    void update(uint32_t now, uint32_t random);
+
+    MqttState state() const { return _state; }
+    static const char* stateName(MqttState state);
+    uint32_t connects() const { return _connects; }
+    uint32_t connectFailures() const { return _connectFailures; }
+    uint32_t lastConnectMs() const { return _lastConnectMs; }
+    uint32_t maxConnectMs() const { return _maxConnectMs; }
+    uint32_t published() const { return _published; }
+    uint32_t replayed() const { return _replayed; }
+    // Messages neither published nor taken by the spool
+    uint32_t lost() const { return _lost; }
+
+private:
+    void startAttempt(uint32_t now);
+    void finishAttempt(int result, uint32_t now, uint32_t random);
+    void attemptFailed(uint32_t now, uint32_t random);
+    void replay(uint32_t now);
+    void drain();
+    bool publish(const MqttOutbox::Message& message);
+
+    MqttOutbox& _outbox;
+    MqttLink& _link;
+    MqttSpool* _spool;
+
+    volatile MqttState _state = MqttState::DISABLED;
+    uint32_t _attemptStartedAt = 0;
+    uint32_t _waitUntil = 0;
+    uint32_t _lastReplayAt = 0;
+    Backoff _backoff{2000, 300000};
+
+    uint32_t _connects = 0;
+    uint32_t _connectFailures = 0;
+    uint32_t _lastConnectMs = 0;
+    uint32_t _maxConnectMs = 0;
+    uint32_t _published = 0;
+    uint32_t _replayed = 0;
+    uint32_t _lost = 0;
+};
+
+#endif
@@ -0,0 +1,53 @@
+#ifndef ONE_TIME_CODE_STORE_H
+#define ONE_TIME_CODE_STORE_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "Credential.h"
+#include "CredentialIndex.h"
+
+enum class RedeemResult {
+    NOT_FOUND,
+    ALREADY_REDEEMED,
+    BLOCKED,
+    REDEEMED
+};
+
+// One entry of the append-only redemption log. listId ties the record to the
+// list it was written for, so records left over from a replaced list are ignored.
+struct RedemptionRecord {
+    uint32_t listId;
+    uint16_t slot;
+    uint16_t reserved;
+    uint32_t redeemedAt;
+};
+
+// One-time codes as an immutable list plus an in-memory redemption bitmap.
+// Redemptions are persisted as RedemptionRecords and folded back into the
+// list's FLAG_REDEEMED bits by foldRedemptions().
+class OneTimeCodeStore {
+public:
+    OneTimeCodeStore();
+
+    bool load(const char* listJson, uint32_t listId);
+    void assign(CredentialIndex&& codes, uint32_t listId);
+    uint32_t listId() const { return _listId; }
+    size_t size() const { return _redeemed.size(); }
+    const CredentialIndex& codes() const { return _codes; }
+
+    RedeemResult redeem(const Credential& credential, bool deliveryBlocked, uint32_t now, const char** labelOut, RedemptionRecord* recordOut);
+    bool apply(const RedemptionRecord& record);
+
+    // Sets FLAG_REDEEMED on every record redeemed since load and returns their
+    // positions in codes().records(), so the caller can update them in place.
+    std::vector<size_t> foldRedemptions();
+    void toJson(std::string& out) const;
+
+private:
+    CredentialIndex _codes;
+    std::vector<bool> _redeemed;
+    uint32_t _listId;
+};
+
+#endif
@@ -0,0 +1,29 @@
+#ifndef STORAGE_H
+#define STORAGE_H
+
+#include <cstddef>
+#include <memory>
+
+// An open file of a Storage; closed when destroyed
+class StorageFile {
+public:
+    virtual ~StorageFile() {}
+    virtual size_t read(void* data, size_t length) = 0;
+    virtual size_t write(const void* data, size_t length) = 0;
+    virtual bool seek(size_t position) = 0;
+    virtual size_t size() = 0;
+};
+
+// The file operations of CredentialStore: LittleFS on the device, files in
+// RAM in the native tests.
+class Storage {
+public:
+    virtual ~Storage() {}
+    // mode as for LittleFS: "r", "w" (truncates), "a" or "r+". Null if the file can't be opened.
+    virtual std::unique_ptr<StorageFile> open(const char* path, const char* mode) = 0;
+    virtual bool exists(const char* path) = 0;
+    virtual bool remove(const char* path) = 0;
+    virtual bool rename(const char* from, const char* to) = 0;
+};
+
+#endif
@@ -0,0 +1,121 @@
+#ifndef WEBHOOK_DISPATCHER_H
+#define WEBHOOK_DISPATCHER_H
+
+#include <Arduino.h>
+#include <HTTPClient.h>
+#include <WiFiClientSecure.h>
+#include <memory>
+#include <string>
+#include <vector>
+#include "Backoff.h"
+#include "WebhookTemplate.h"
+#include "state.h"
+
+class WebhookDispatcher;
+
+// One configured webhook target. Events matching its mask are collected for
+// batchMs after the first one and then sent as a single POST; a sink without
+// a body sends one GET per event instead.
+struct WebhookSink {
+    std::string name;
+    std::string url;       // template, TemplateEscape::URL
+    std::string body;      // template, TemplateEscape::JSON; empty sends a GET
+    uint32_t eventMask = WEBHOOK_ALL;
+    uint32_t batchMs = 0;
+    bool insecure = false;
+    // The Callback URL setting rather than an entry of WEBHOOKS_PATH
+    bool builtin = false;
+
+    // Guarded by the dispatcher's mutex; the first inFlight events are being sent
+    std::vector<WebhookEvent> pending;
+    size_t inFlight = 0;
+    uint32_t readyAt = 0;
+    uint8_t attempts = 0;
+    Backoff backoff{1000, 60000};
+    std::unique_ptr<HTTPClient> http;
+    std::unique_ptr<WiFiClient> client;
+    bool secure = false;
+    // Scheme, host and port of the open connection
+    String origin;
+    // The secure client keeps a pointer to the PEM
+    std::shared_ptr<const std::string> caCert;
+
+    uint32_t delivered = 0;
+    uint32_t failed = 0;
+    uint32_t dropped = 0;
+    uint32_t lastLatencyMs = 0;
+
+    // Served by its own task. stopping is set when the sink list is replaced; the task then deletes the sink.
+    WebhookDispatcher* dispatcher = nullptr;
+    TaskHandle_t task = nullptr;
+    bool stopping = false;
+};
+
+// Fans lock events out to the sinks in WEBHOOKS_PATH plus the legacy
+// callback URL (a GET on "open"). One background task routes the events so
+// an opening never waits on the network; every sink then sends on its own
+// task, so a sink that is down (up to two timeouts per attempt) never delays
+// the others. Connections are kept alive per sink, and a failing sink backs
+// off on its own schedule.
+class WebhookDispatcher {
+public:
+    void begin();
+    // Never blocks; returns false (and counts a drop) if the queue is full
+    bool enqueue(const char* type, const char* compartment, const char* source, const char* label);
+    // Reloads the sinks and the callback settings before the next delivery
+    void requestReconfigure() { _reconfigureRequested = true; }
+
+    // Validates and stores the sink list; returns an error message or nullptr
+    const char* saveSinks(const char* json);
+    // Sink definitions and their counters as JSON
+    String statusJson();
+
+    uint32_t queueDepth() const;
+    uint32_t delivered() const { return _delivered; }
+    uint32_t failed() const { return _failed; }
+    uint32_t dropped() const { return _dropped; }
+    uint32_t retries() const { return _retries; }
+    uint32_t lastLatencyMs() const { return _lastLatencyMs; }
+    uint32_t maxLatencyMs() const { return _maxLatencyMs; }
+
+private:
+    static void workerTask(void* param);
+    static void sinkTask(void* param);
+    void run();
+    void runSink(WebhookSink& sink);
+    void loadSinks();
+    void distribute(const WebhookEvent& event);
+    void pollState();
+    void finish(WebhookSink& sink, uint32_t firstAt, bool ok);
+    bool deliver(WebhookSink& sink, const WebhookEvent* events, size_t count);
+    static void resetClient(WebhookSink& sink);
+
+    static const uint8_t QUEUE_LENGTH = 16;
+    static const uint8_t MAX_SINKS = 4;
+    static const uint8_t MAX_PENDING = 16;
+    static const uint8_t MAX_ATTEMPTS = 5;
+    static const uint32_t MAX_BATCH_MS = 60000;
+    static const uint16_t TIMEOUT_MS = 5000;
+    static const uint32_t POLL_MS = 50;
+    // TLS needs the larger stack; at most MAX_SINKS + 1 sink tasks
+    static const uint32_t SINK_STACK = 8192;
+
+    QueueHandle_t _queue = nullptr;
+    SemaphoreHandle_t _mutex = nullptr;
+    volatile bool _reconfigureRequested = false;
+    std::vector<std::unique_ptr<WebhookSink>> _sinks;
+    MailboxState _lastState = LOCKED;
+    // The later events of an opening name the same requester
+    WebhookEvent _lastOpen = {};
+
+    uint32_t _delivered = 0;
+    uint32_t _failed = 0;
+    uint32_t _dropped = 0;
+    uint32_t _retries = 0;
+    uint32_t _lastLatencyMs = 0;
+    uint32_t _maxLatencyMs = 0;
+};
+
+extern WebhookDispatcher webhookDispatcher;
+
+#endif
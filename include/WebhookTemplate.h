@@ -0,0 +1,39 @@
+#ifndef WEBHOOK_TEMPLATE_H
+#define WEBHOOK_TEMPLATE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// One lock event handed to the webhook sinks
+struct WebhookEvent {
+    char type[12];        // see WebhookEventType
+    char compartment[8];  // "parcel", "mail" or empty
+    char requester[48];   // label if there is one, else source
+    char label[48];       // label of the code that opened, empty for other sources
+    char source[16];      // "wiegand", "mqtt" or "webinterface"
+    uint32_t at;          // millis() when it happened
+};
+
+enum WebhookEventType : uint32_t {
+    WEBHOOK_OPEN   = 1 << 0,  // opening accepted, before the motor runs
+    WEBHOOK_OPENED = 1 << 1,  // compartment reached its open switch
+    WEBHOOK_LOCKED = 1 << 2,  // door closed and locked again
+    WEBHOOK_ERROR  = 1 << 3,  // motor error
+    WEBHOOK_ALL    = 0x0F
+};
+
+enum class TemplateEscape {
+    JSON,  // for request bodies; values are escaped for use inside JSON strings
+    URL    // for URLs; values are percent-encoded
+};
+
+// Bit for an event name ("open", "opened", "locked", "error"), 0 if unknown
+uint32_t webhookEventBit(const char* type);
+
+// Expands {event}, {compartment}, {requester}, {label}, {source} and {time}
+// with the newest event of the batch, {count} with the batch size and {events} with
+// the whole batch as a JSON array. Unknown placeholders are kept verbatim.
+std::string renderWebhookTemplate(const char* tmpl, const WebhookEvent* events, size_t count, TemplateEscape escape);
+
+#endif
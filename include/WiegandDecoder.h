@@ -0,0 +1,36 @@
+#ifndef WIEGAND_DECODER_H
+#define WIEGAND_DECODER_H
+
+#include <cstddef>
+#include <cstdint>
+#include "Credential.h"
+
+enum class WiegandFrame {
+    IGNORED,
+    KEY_DIGIT,
+    KEYPAD_PIN,
+    CARD
+};
+
+// Hardware-independent part of WiegandManager: turns raw frames from the
+// reader into Credentials and assembles keypad digits into PINs.
+class WiegandDecoder {
+public:
+    static const unsigned long KEYPAD_TIMEOUT_MS = 10000;
+    static const uint8_t MAX_PIN_DIGITS = 16;
+
+    WiegandDecoder();
+
+    // Returns CARD or KEYPAD_PIN when credentialOut holds a complete credential.
+    WiegandFrame decode(uint64_t rawCode, uint8_t bitCount, unsigned long now, Credential& credentialOut);
+    // Drops a partially entered PIN after KEYPAD_TIMEOUT_MS. Returns true if one was dropped.
+    bool expire(unsigned long now);
+    uint8_t pendingDigits() const { return _keypadPinLen; }
+
+private:
+    uint64_t _keypadPin;
+    uint8_t _keypadPinLen;
+    unsigned long _lastKeypadPressTime;
+};
+
+#endif
@@ -3,11 +3,12 @@
 
 #include <Arduino.h>
 #include <Wiegand.h>
+#include "WiegandDecoder.h"
 
 class WiegandManager {
 public:
     WiegandManager(int d0Pin, int d1Pin);
-    void begin(void (*onCodeCallback)(char* code, uint8_t bits));
+    void begin(void (*onCodeCallback)(const Credential& credential));
     void update();
     void attach();
     void detach();
@@ -17,12 +18,9 @@ private:
     int _d0Pin;
     int _d1Pin;
     bool _attached;
-    void (*_onCodeCallback)(char* code, uint8_t bits);
+    void (*_onCodeCallback)(const Credential& credential);
     Wiegand _wiegand;
-
-    char _keypadPinStr[20];
-    uint8_t _keypadPinLen;
-    unsigned long _lastKeypadPressTime;
+    WiegandDecoder _decoder;
 };
 
 extern WiegandManager wiegandManager;
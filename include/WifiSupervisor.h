@@ -0,0 +1,83 @@
+#ifndef WIFI_SUPERVISOR_H
+#define WIFI_SUPERVISOR_H
+
+#include <Arduino.h>
+#include "Backoff.h"
+
+enum class WifiState : uint8_t {
+    SETUP,          // no SSID configured, SoftAP only
+    CONNECTING,
+    WAITING,        // backing off before the next attempt
+    CONNECTED
+};
+
+// Last association, used to join without a channel scan. Kept in RTC memory
+// (survives restarts) and NVS (survives power loss). The DHCP lease is not
+// cached: reusing it as a static address would outlive the lease on the router.
+struct WifiCache {
+    uint32_t magic;
+    uint32_t ssidHash;
+    uint8_t bssid[6];
+    uint8_t channel;
+    uint8_t reserved;
+    uint32_t crc;
+};
+
+// Owns the station connection on its own task: joins with the cached BSSID
+// and channel first, retries with backoff and only opens the SoftAP after
+// SOFTAP_AFTER_MS without a link.
+class WifiSupervisor {
+public:
+    void begin();
+    // Re-joins with the current WiFi settings
+    void requestReconnect() { _reconnectRequested = true; }
+
+    WifiState state() const { return _state; }
+    static const char* stateName(WifiState state);
+    bool softApActive() const { return _softApActive; }
+    const WifiCache& cache() const { return _cache; }
+    uint32_t reconnects() const { return _reconnects; }
+    uint32_t lastReconnectMs() const { return _lastReconnectMs; }
+    uint32_t maxReconnectMs() const { return _maxReconnectMs; }
+    uint32_t fastConnects() const { return _fastConnects; }
+    uint32_t failedAttempts() const { return _failedAttempts; }
+
+private:
+    static void supervisorTask(void* param);
+    void update();
+    void startAttempt();
+    void onConnected();
+    void onAttemptFailed();
+    void startSoftAP();
+    void stopSoftAP();
+    bool cacheMatches() const;
+    void loadCache();
+    void storeCache();
+
+    static const unsigned long FAST_ATTEMPT_TIMEOUT_MS = 5000;
+    static const unsigned long ATTEMPT_TIMEOUT_MS = 15000;
+    static const unsigned long SOFTAP_AFTER_MS = 5UL * 60UL * 1000UL;
+    static const unsigned long SOFTAP_LINGER_MS = 30000;
+
+    volatile WifiState _state = WifiState::SETUP;
+    volatile bool _reconnectRequested = false;
+    bool _softApActive = false;
+    bool _fastPath = false;
+    bool _everConnected = false;
+    unsigned long _attemptStartedAt = 0;
+    unsigned long _waitUntil = 0;
+    unsigned long _offlineSince = 0;
+    unsigned long _connectedAt = 0;
+    Backoff _backoff{1000, 60000};
+    WifiCache _cache = {};
+
+    uint32_t _reconnects = 0;
+    uint32_t _lastReconnectMs = 0;
+    uint32_t _maxReconnectMs = 0;
+    uint32_t _fastConnects = 0;
+    uint32_t _failedAttempts = 0;
+};
+
+extern WifiSupervisor wifiSupervisor;
+
+#endif
@@ -2,33 +2,59 @@
 #define CONFIG_H
 
 #include <Arduino.h>
+#include <string.h>
 
+// Fixed-capacity buffers so the settings never reallocate on the heap. Copies
+// are plain struct copies; the sizes include the terminator.
 struct Config {
-  String ssid;
-  String password;
-  String ownerCodes;
-  String deliveryCodes;
-  String mqttServer;
+  char ssid[33];
+  char password[65];
+  char mqttServer[128];
   int mqttPort;
-  String mqttUser;
-  String mqttPassword;
+  char mqttUser[65];
+  char mqttPassword[65];
   int dutyCycleOpen;
   int dutyCycleClose;
-  String selectedMelody;
-  String callbackUrl;
+  char selectedMelody[24];
+  char callbackUrl[256];
   bool autolock;
-  String oneTimeCodes;
   bool oneTimeOpening;
   bool mqttUseTls;
   bool mqttSkipCertVal;
   bool callbackSkipCertVal;
+  // MqttEncoding. Sits in what used to be padding, so the snapshot keeps its
+  // size and settings from earlier firmware read as 0 (JSON).
+  uint8_t mqttEncoding;
 };
 
+enum MqttEncoding : uint8_t {
+  MQTT_ENCODING_JSON = 0,     // paketkasten/state only, as before
+  MQTT_ENCODING_MSGPACK = 1,  // paketkasten/v1/msgpack/state only
+  MQTT_ENCODING_BOTH = 2      // both, while subscribers migrate
+};
+
+// Copies value into a Config field; fails instead of truncating. The rest of
+// the buffer is cleared so no old value lingers in the stored snapshot.
+template <size_t N>
+bool setConfigField(char (&field)[N], const char* value) {
+  size_t length = strlen(value);
+  if (length >= N) {
+    return false;
+  }
+  memcpy(field, value, length);
+  memset(field + length, 0, N - length);
+  return true;
+}
+
 const char* const PREFERENCES_NAMESPACE = "mailbox";
+// Settings are stored as one A/B snapshot (see ConfigManager); the per-key
+// names below are only read to migrate earlier firmware.
 const char* const SSID_KEY = "ssid";
 const char* const PASSWORD_KEY = "password";
+// Code lists of earlier firmware, migrated to CREDENTIALS_PATH on first boot
 const char* const OWNER_CODE_KEY = "ownerCode";
 const char* const DELIVERY_CODE_KEY = "deliveryCode";
+const char* const ONE_TIME_CODES_KEY = "oneTimeCodes";
 const char* const MQTT_SERVER_KEY = "mqttServer";
 const char* const MQTT_PORT_KEY = "mqttPort";
 const char* const MQTT_USER_KEY = "mqttUser";
@@ -38,11 +64,18 @@ const char* const DUTY_CYCLE_CLOSE_KEY = "dutyCycleClose";
 const char* const SELECTED_MELODY_KEY = "selectedMelody";
 const char* const CALLBACK_URL_KEY = "callbackUrl";
 const char* const AUTOLOCK_KEY = "autolock";
-const char* const ONE_TIME_CODES_KEY = "oneTimeCodes";
 const char* const ONE_TIME_OPENING_KEY = "oneTimeOpen";
 const char* const DELIVERY_BLOCKED_KEY = "delBlocked";
 const char* const MQTT_USE_TLS_KEY = "mqttUseTls";
 const char* const MQTT_SKIP_CERT_VAL_KEY = "mqttSkipCert";
 const char* const CALLBACK_SKIP_CERT_VAL_KEY = "cbSkipCert";
+const char* const NVS_WRITES_KEY = "nvsWrites";
+
+const char* const CREDENTIALS_PATH = "/credentials.bin";
+const char* const CREDENTIALS_JOURNAL_PATH = "/credentials.log";
+const char* const ONE_TIME_LOG_PATH = "/otc_redeemed.log";
+const char* const WEBHOOKS_PATH = "/webhooks.json";
+// Segments of the MQTT store-and-forward journal, see EventJournal
+const char* const MQTT_JOURNAL_PATHS[2] = { "/mqtt_journal.0", "/mqtt_journal.1" };
 
 #endif
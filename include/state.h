@@ -3,6 +3,8 @@
 
 #include <Arduino.h>
 #include <vector>
+#include "Credential.h"
+#include "MqttOutbox.h"
 
 enum MailboxState {
   LOCKED,
@@ -39,8 +41,8 @@ extern const char* SOFTAP_PASSWORD;
 // Global shared variables
 extern volatile MailboxState currentState;
 extern volatile bool deliveryBlocked;
-extern char lastScannedWiegandId[20];
-extern char lastKeypadCode[20];
+extern Credential lastScannedCredential;
+extern Credential lastKeypadCredential;
 extern char lastUsed[50];
 extern volatile unsigned long openStateEnterTime;
 extern unsigned long preOpeningStateEnterTime;
@@ -48,6 +50,7 @@ extern volatile unsigned long motorStartTime;
 extern volatile unsigned long lockedStateEnterTime;
 extern volatile bool wiegandAttached;
 extern volatile bool shouldRestart;
+extern volatile uint32_t credentialScanCount;
 
 // Calibration variables
 extern volatile bool calibrationActive;
@@ -57,13 +60,13 @@ extern volatile unsigned long calibrationStepTime;
 extern int calibratedOpen;
 extern int calibratedClose;
 
-extern std::vector<String> mqttMessageQueue;
-extern SemaphoreHandle_t mqttQueueMutex;
-
 // Global orchestrator functions
+const char* mailboxStateName(MailboxState state);
 String getMailboxStateString();
-void requestParcelOpening(const char* requester);
-void requestMailOpening(const char* requester);
+// False if nothing was started: not LOCKED, just locked (2.5 s hold-off) or calibrating
+// source is "wiegand", "mqtt" or "webinterface"; label that of the code used, if any
+bool requestParcelOpening(const char* source, const char* label = "");
+bool requestMailOpening(const char* source, const char* label = "");
 void publishState();
 void startCalibration();
 void updateCalibration();
@@ -1,52 +1,50 @@
 #include "AccessControl.h"
-#include <ArduinoJson.h>
-#include <cstring>
 
-AccessType AccessControl::evaluate(const char* scannedCode, const char* ownerCodesJson, const char* deliveryCodesJson, std::string* labelOut) {
-    if (!scannedCode || !ownerCodesJson || !deliveryCodesJson) {
+static AccessType resolve(const CredentialRecord* record, const CredentialIndex& credentials, const char** labelOut) {
+    if (!record) {
+        return AccessType::DENIED;
+    }
+
+    if (labelOut) {
+        const char* label = credentials.label(*record);
+        *labelOut = label ? label : "unknown";
+    }
+
+    switch (static_cast<CredentialGroup>(record->group)) {
+        case CredentialGroup::OWNER: return AccessType::OPEN_MAIL;
+        case CredentialGroup::DELIVERY: return AccessType::OPEN_PARCEL;
+        default: return AccessType::DENIED;
+    }
+}
+
+AccessType AccessControl::evaluate(const Credential& credential, const CredentialIndex& credentials, const char** labelOut) {
+    if (!credential.isValid()) {
         return AccessType::DENIED;
     }
+    return resolve(credentials.find(credential.value(), credential.digits), credentials, labelOut);
+}
 
-    // Convert scanned HEX code to its decimal representation
-    char scannedCodeDec[32] = "";
-    unsigned long val = strtoul(scannedCode, nullptr, 16);
-    snprintf(scannedCodeDec, sizeof(scannedCodeDec), "%lu", val);
-
-    JsonDocument doc;
-    
-    // Check owner (mail) codes first
-    DeserializationError error = deserializeJson(doc, ownerCodesJson);
-    if (!error) {
-        JsonArray array = doc.as<JsonArray>();
-        for (JsonObject obj : array) {
-            const char* objCode = obj["code"];
-            if (objCode && (strcmp(objCode, scannedCode) == 0 || strcmp(objCode, scannedCodeDec) == 0)) {
-                if (labelOut) {
-                    const char* label = obj["label"];
-                    *labelOut = label ? label : "unknown";
-                }
-                return AccessType::OPEN_MAIL;
-            }
-        }
+AccessType AccessControl::evaluate(const char* scannedCode, const CredentialIndex& credentials, const char** labelOut) {
+    if (!scannedCode) {
+        return AccessType::DENIED;
     }
+    return resolve(credentials.findScanned(scannedCode), credentials, labelOut);
+}
 
-    doc.clear();
-    
-    // Check delivery (parcel) codes
-    error = deserializeJson(doc, deliveryCodesJson);
-    if (!error) {
-        JsonArray array = doc.as<JsonArray>();
-        for (JsonObject obj : array) {
-            const char* objCode = obj["code"];
-            if (objCode && (strcmp(objCode, scannedCode) == 0 || strcmp(objCode, scannedCodeDec) == 0)) {
-                if (labelOut) {
-                    const char* label = obj["label"];
-                    *labelOut = label ? label : "unknown";
-                }
-                return AccessType::OPEN_PARCEL;
-            }
-        }
+AccessType AccessControl::evaluate(const char* scannedCode, const char* ownerCodesJson, const char* deliveryCodesJson, std::string* labelOut) {
+    if (!scannedCode || !ownerCodesJson || !deliveryCodesJson) {
+        return AccessType::DENIED;
     }
 
-    return AccessType::DENIED;
+    CredentialIndex credentials;
+    credentials.addJson(ownerCodesJson, CredentialGroup::OWNER);
+    credentials.addJson(deliveryCodesJson, CredentialGroup::DELIVERY);
+    credentials.finalize();
+
+    const char* label = nullptr;
+    AccessType result = evaluate(scannedCode, credentials, &label);
+    if (labelOut && result != AccessType::DENIED) {
+        *labelOut = label;
+    }
+    return result;
 }
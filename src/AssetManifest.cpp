@@ -0,0 +1,99 @@
+#include "AssetManifest.h"
+#include <cstring>
+
+static const char* skipSpaces(const char* p) {
+    while (*p == ' ' || *p == '\t') {
+        p++;
+    }
+    return p;
+}
+
+static const char* fieldEnd(const char* p) {
+    while (*p && *p != ' ' && *p != '\t' && *p != '\r' && *p != '\n') {
+        p++;
+    }
+    return p;
+}
+
+size_t AssetManifest::parse(const char* text) {
+    _assets.clear();
+    const char* p = text;
+    while (*p) {
+        const char* lineEnd = p;
+        while (*lineEnd && *lineEnd != '\n') {
+            lineEnd++;
+        }
+
+        const char* fields[4];
+        size_t lengths[4];
+        size_t count = 0;
+        const char* q = skipSpaces(p);
+        while (count < 4 && q < lineEnd && *q != '\r') {
+            // The content type is the rest of the line
+            const char* end = count == 3 ? lineEnd : fieldEnd(q);
+            while (count == 3 && end > q && (end[-1] == '\r' || end[-1] == ' ')) {
+                end--;
+            }
+            fields[count] = q;
+            lengths[count] = end - q;
+            count++;
+            q = skipSpaces(end);
+        }
+
+        if (count == 4 && fields[0][0] == '/' && (fields[2][0] == '0' || fields[2][0] == '1') && lengths[2] == 1) {
+            Asset asset;
+            asset.path.assign(fields[0], lengths[0]);
+            asset.etag.reserve(lengths[1] + 2);
+            asset.etag += '"';
+            asset.etag.append(fields[1], lengths[1]);
+            asset.etag += '"';
+            asset.gzipped = fields[2][0] == '1';
+            asset.contentType.assign(fields[3], lengths[3]);
+            _assets.push_back(std::move(asset));
+        }
+
+        p = *lineEnd ? lineEnd + 1 : lineEnd;
+    }
+    return _assets.size();
+}
+
+const Asset* AssetManifest::find(const char* path) const {
+    for (const Asset& asset : _assets) {
+        if (asset.path == path) {
+            return &asset;
+        }
+    }
+    return nullptr;
+}
+
+bool AssetManifest::etagMatches(const char* ifNoneMatch, const std::string& etag) {
+    if (!ifNoneMatch) {
+        return false;
+    }
+    const char* p = ifNoneMatch;
+    while (*p) {
+        while (*p == ' ' || *p == ',') {
+            p++;
+        }
+        if (*p == '*') {
+            return true;
+        }
+        // If-None-Match uses the weak comparison
+        if (p[0] == 'W' && p[1] == '/') {
+            p += 2;
+        }
+        const char* end = p;
+        while (*end && *end != ',') {
+            end++;
+        }
+        const char* tagEnd = end;
+        while (tagEnd > p && tagEnd[-1] == ' ') {
+            tagEnd--;
+        }
+        if (static_cast<size_t>(tagEnd - p) == etag.size() && memcmp(p, etag.data(), etag.size()) == 0) {
+            return true;
+        }
+        p = end;
+    }
+    return false;
+}
@@ -0,0 +1,25 @@
+#include "Backoff.h"
+
+Backoff::Backoff(uint32_t initialMs, uint32_t maxMs, uint8_t jitterPercent) :
+    _initialMs(initialMs),
+    _maxMs(maxMs),
+    _jitterPercent(jitterPercent)
+{}
+
+uint32_t Backoff::next(uint32_t random) {
+    uint32_t base = _maxMs;
+    // Past 16 doublings any practical initial delay has long reached maxMs
+    if (_failures < 16 && (static_cast<uint64_t>(_initialMs) << _failures) < _maxMs) {
+        base = _initialMs << _failures;
+    }
+    if (_failures < UINT16_MAX) {
+        _failures++;
+    }
+
+    uint32_t spread = static_cast<uint32_t>(static_cast<uint64_t>(base) * _jitterPercent / 100);
+    if (spread == 0) {
+        return base;
+    }
+    // Uniform in [base - spread, base + spread]
+    return base - spread + random % (2 * spread + 1);
+}
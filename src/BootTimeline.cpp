@@ -0,0 +1,25 @@
+#include "BootTimeline.h"
+
+BootTimeline bootTimeline;
+
+void BootTimeline::mark(BootPhase phase) {
+    if (reached(phase)) {
+        return;
+    }
+    _at[static_cast<uint8_t>(phase)] = millis();
+    _reached |= 1u << static_cast<uint8_t>(phase);
+    Serial.printf("Boot phase %s reached after %lu ms\n", name(phase), (unsigned long)at(phase));
+}
+
+const char* BootTimeline::name(BootPhase phase) {
+    switch (phase) {
+        case BootPhase::CONFIG_LOADED:      return "config_loaded";
+        case BootPhase::HARDWARE_READY:     return "hardware_ready";
+        case BootPhase::LOCK_ONLINE:        return "lock_online";
+        case BootPhase::WEB_SERVER_STARTED: return "web_server_started";
+        case BootPhase::WIFI_CONNECTED:     return "wifi_connected";
+        case BootPhase::SOFTAP_STARTED:     return "softap_started";
+        case BootPhase::MQTT_CONNECTED:     return "mqtt_connected";
+        default:                            return "unknown";
+    }
+}
@@ -0,0 +1,94 @@
+#include "CertStore.h"
+#include <FS.h>
+#include <LittleFS.h>
+
+CertStore certStore;
+
+static std::shared_ptr<const mbedtls_x509_crt> parseChain(const std::string& pem) {
+    if (pem.empty()) {
+        return nullptr;
+    }
+    mbedtls_x509_crt* crt = new mbedtls_x509_crt;
+    mbedtls_x509_crt_init(crt);
+    // PEM input must include the terminating NUL in its length
+    int ret = mbedtls_x509_crt_parse(crt, reinterpret_cast<const unsigned char*>(pem.c_str()), pem.size() + 1);
+    if (ret < 0) {
+        Serial.printf("CA certificate does not parse (-0x%04x)\n", -ret);
+        mbedtls_x509_crt_free(crt);
+        delete crt;
+        return nullptr;
+    }
+    return std::shared_ptr<const mbedtls_x509_crt>(crt, [](const mbedtls_x509_crt* chain) {
+        mbedtls_x509_crt* owned = const_cast<mbedtls_x509_crt*>(chain);
+        mbedtls_x509_crt_free(owned);
+        delete owned;
+    });
+}
+
+void CertStore::begin() {
+    _mutex = xSemaphoreCreateMutex();
+    for (uint8_t i = 0; i < static_cast<uint8_t>(CertId::COUNT); i++) {
+        CertId id = static_cast<CertId>(i);
+        std::string pem;
+        File file;
+        if (LittleFS.exists(path(id))) {
+            file = LittleFS.open(path(id), "r");
+        }
+        if (file) {
+            pem.resize(file.size());
+            pem.resize(file.read(reinterpret_cast<uint8_t*>(&pem[0]), pem.size()));
+            file.close();
+        }
+        assign(id, std::move(pem));
+    }
+}
+
+bool CertStore::save(CertId id, const String& pem) {
+    std::shared_ptr<const std::string> current = this->pem(id);
+    if (current->size() == pem.length() && memcmp(current->data(), pem.c_str(), pem.length()) == 0) {
+        return false;
+    }
+    if (!LittleFS.exists("/certs")) {
+        LittleFS.mkdir("/certs");
+    }
+    File file = LittleFS.open(path(id), "w");
+    if (!file) {
+        return false;
+    }
+    file.print(pem);
+    file.close();
+    assign(id, std::string(pem.c_str(), pem.length()));
+    return true;
+}
+
+void CertStore::assign(CertId id, std::string&& pem) {
+    // Parsed outside the lock; readers keep using the old entry meanwhile
+    Entry entry;
+    entry.chain = parseChain(pem);
+    entry.pem = std::make_shared<const std::string>(std::move(pem));
+    xSemaphoreTake(_mutex, portMAX_DELAY);
+    _entries[static_cast<uint8_t>(id)] = std::move(entry);
+    xSemaphoreGive(_mutex);
+}
+
+std::shared_ptr<const std::string> CertStore::pem(CertId id) {
+    xSemaphoreTake(_mutex, portMAX_DELAY);
+    std::shared_ptr<const std::string> pem = _entries[static_cast<uint8_t>(id)].pem;
+    xSemaphoreGive(_mutex);
+    return pem;
+}
+
+std::shared_ptr<const mbedtls_x509_crt> CertStore::chain(CertId id) {
+    xSemaphoreTake(_mutex, portMAX_DELAY);
+    std::shared_ptr<const mbedtls_x509_crt> chain = _entries[static_cast<uint8_t>(id)].chain;
+    xSemaphoreGive(_mutex);
+    return chain;
+}
+
+const char* CertStore::path(CertId id) {
+    switch (id) {
+        case CertId::MQTT_CA:     return "/certs/mqtt_ca.pem";
+        case CertId::CALLBACK_CA: return "/certs/callback_ca.pem";
+        default:                  return "";
+    }
+}
@@ -1,136 +1,591 @@
 #include "ConfigManager.h"
+#include "CredentialStore.h"
+#include "Crc32.h"
+#include "LittleFsStorage.h"
 #include "state.h"
 #include <Preferences.h>
-#include <ArduinoJson.h>
+#include <LittleFS.h>
 
 Preferences preferences;
 ConfigManager configManager;
 
-ConfigManager::ConfigManager() {}
+ConfigManager::ConfigManager() :
+    _credentials(std::make_shared<CredentialIndex>())
+{}
 
 void ConfigManager::begin() {
+    _persistMutex = xSemaphoreCreateMutex();
+    _credentialMutex = xSemaphoreCreateMutex();
+    _snapshotMutex = xSemaphoreCreateMutex();
     load();
+    // Lowest priority: NVS writes only happen when nothing else wants the core
+    xTaskCreatePinnedToCore(persistTask, "PersistTask", 4096, this, tskIDLE_PRIORITY, &_persistTask, 0);
+}
+
+// One A/B slot of the settings. The slot with the highest valid sequence wins,
+// so a power loss while writing one slot always leaves the other intact.
+struct ConfigSnapshot {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t size;
+    uint32_t sequence;
+    uint32_t nvsWrites;
+    Config config;
+    bool deliveryBlocked;
+    uint32_t crc;               // CRC-32 of everything before this field
+};
+
+static const uint32_t CONFIG_MAGIC = 0x47464350; // "PCFG"
+static const uint16_t CONFIG_VERSION = 1;
+static const char* const CONFIG_SLOT_KEYS[2] = { "cfgA", "cfgB" };
+
+static uint32_t snapshotCrc(const ConfigSnapshot& snapshot) {
+    return crc32Update(0, &snapshot, offsetof(ConfigSnapshot, crc));
+}
+
+static bool readSnapshot(const char* key, ConfigSnapshot& snapshot) {
+    return preferences.getBytesLength(key) == sizeof(snapshot) &&
+           preferences.getBytes(key, &snapshot, sizeof(snapshot)) == sizeof(snapshot) &&
+           snapshot.magic == CONFIG_MAGIC && snapshot.version == CONFIG_VERSION &&
+           snapshot.size == sizeof(ConfigSnapshot) && snapshot.crc == snapshotCrc(snapshot);
+}
+
+// Fields compared one by one; padding and bytes after a terminator don't count
+static uint32_t diffConfig(const Config& a, const Config& b) {
+    uint32_t changes = 0;
+    if (strcmp(a.ssid, b.ssid) != 0 || strcmp(a.password, b.password) != 0) {
+        changes |= CONFIG_WIFI;
+    }
+    if (strcmp(a.mqttServer, b.mqttServer) != 0 || a.mqttPort != b.mqttPort ||
+        strcmp(a.mqttUser, b.mqttUser) != 0 || strcmp(a.mqttPassword, b.mqttPassword) != 0 ||
+        a.mqttUseTls != b.mqttUseTls || a.mqttSkipCertVal != b.mqttSkipCertVal || a.mqttEncoding != b.mqttEncoding) {
+        changes |= CONFIG_MQTT;
+    }
+    if (a.dutyCycleOpen != b.dutyCycleOpen || a.dutyCycleClose != b.dutyCycleClose) {
+        changes |= CONFIG_MOTOR;
+    }
+    if (strcmp(a.selectedMelody, b.selectedMelody) != 0) {
+        changes |= CONFIG_MELODY;
+    }
+    if (strcmp(a.callbackUrl, b.callbackUrl) != 0 || a.callbackSkipCertVal != b.callbackSkipCertVal) {
+        changes |= CONFIG_CALLBACK;
+    }
+    if (a.autolock != b.autolock || a.oneTimeOpening != b.oneTimeOpening) {
+        changes |= CONFIG_ACCESS;
+    }
+    return changes;
 }
 
 void ConfigManager::load() {
+    unsigned long start = micros();
     preferences.begin(PREFERENCES_NAMESPACE, false);
-    _config.ssid = preferences.getString(SSID_KEY, "");
-    _config.password = preferences.getString(PASSWORD_KEY, "");
-    _config.ownerCodes = preferences.getString(OWNER_CODE_KEY, "[]");
-    _config.deliveryCodes = preferences.getString(DELIVERY_CODE_KEY, "[]");
-    _config.mqttServer = preferences.getString(MQTT_SERVER_KEY, "");
+    bool loaded = loadSnapshot();
+    if (!loaded) {
+        loadLegacyKeys();
+    }
+    preferences.end();
+    _configLoadMicros = micros() - start;
+
+    _persisted = _config;
+    _persistedDeliveryBlocked = deliveryBlocked;
+    _dirty = false;
+    if (!loaded) {
+        // First boot or earlier firmware: write the first snapshot, then drop the old keys
+        _dirty = true;
+        if (flush()) {
+            removeLegacyKeys();
+        }
+    }
+    Serial.printf("Configuration loaded from %s in %lu us\n", loaded ? CONFIG_SLOT_KEYS[_activeSlot] : "legacy keys", _configLoadMicros);
+    lockCredentials();
+    loadCredentials();
+    unlockCredentials();
+}
+
+bool ConfigManager::loadSnapshot() {
+    ConfigSnapshot slots[2];
+    bool valid[2] = { readSnapshot(CONFIG_SLOT_KEYS[0], slots[0]), readSnapshot(CONFIG_SLOT_KEYS[1], slots[1]) };
+    if (!valid[0] && !valid[1]) {
+        return false;
+    }
+    uint8_t slot = !valid[0] || (valid[1] && slots[1].sequence > slots[0].sequence) ? 1 : 0;
+    _config = slots[slot].config;
+    deliveryBlocked = slots[slot].deliveryBlocked;
+    _nvsWritesTotal = slots[slot].nvsWrites;
+    _sequence = slots[slot].sequence;
+    _activeSlot = slot;
+    return true;
+}
+
+template <size_t N>
+static void loadString(const char* key, char (&field)[N], const char* defaultValue) {
+    if (!preferences.isKey(key) || preferences.getString(key, field, N) == 0) {
+        setConfigField(field, defaultValue);
+    }
+}
+
+// Per-key layout of earlier firmware; also yields the defaults on a blank device
+void ConfigManager::loadLegacyKeys() {
+    memset(&_config, 0, sizeof(_config));
+    loadString(SSID_KEY, _config.ssid, "");
+    loadString(PASSWORD_KEY, _config.password, "");
+    loadString(MQTT_SERVER_KEY, _config.mqttServer, "");
     _config.mqttPort = preferences.getInt(MQTT_PORT_KEY, 1883);
-    _config.mqttUser = preferences.getString(MQTT_USER_KEY, "");
-    _config.mqttPassword = preferences.getString(MQTT_PASSWORD_KEY, "");
+    loadString(MQTT_USER_KEY, _config.mqttUser, "");
+    loadString(MQTT_PASSWORD_KEY, _config.mqttPassword, "");
     _config.dutyCycleOpen = preferences.getInt(DUTY_CYCLE_OPEN_KEY, 120);
     _config.dutyCycleClose = preferences.getInt(DUTY_CYCLE_CLOSE_KEY, 20);
-    _config.selectedMelody = preferences.getString(SELECTED_MELODY_KEY, "NOKIA_TUNE");
-    _config.callbackUrl = preferences.getString(CALLBACK_URL_KEY, "");
+    loadString(SELECTED_MELODY_KEY, _config.selectedMelody, "NOKIA_TUNE");
+    loadString(CALLBACK_URL_KEY, _config.callbackUrl, "");
     _config.autolock = preferences.getBool(AUTOLOCK_KEY, true);
-    _config.oneTimeCodes = preferences.getString(ONE_TIME_CODES_KEY, "[]");
     _config.oneTimeOpening = preferences.getBool(ONE_TIME_OPENING_KEY, false);
     _config.mqttUseTls = preferences.getBool(MQTT_USE_TLS_KEY, false);
     _config.mqttSkipCertVal = preferences.getBool(MQTT_SKIP_CERT_VAL_KEY, false);
     _config.callbackSkipCertVal = preferences.getBool(CALLBACK_SKIP_CERT_VAL_KEY, false);
     deliveryBlocked = preferences.getBool(DELIVERY_BLOCKED_KEY, false);
+    _nvsWritesTotal = preferences.getUInt(NVS_WRITES_KEY, _nvsWritesTotal);
+    _sequence = 0;
+    _activeSlot = 1;
+}
+
+void ConfigManager::removeLegacyKeys() {
+    static const char* const keys[] = {
+        SSID_KEY, PASSWORD_KEY, MQTT_SERVER_KEY, MQTT_PORT_KEY, MQTT_USER_KEY, MQTT_PASSWORD_KEY,
+        DUTY_CYCLE_OPEN_KEY, DUTY_CYCLE_CLOSE_KEY, SELECTED_MELODY_KEY, CALLBACK_URL_KEY, AUTOLOCK_KEY,
+        ONE_TIME_OPENING_KEY, MQTT_USE_TLS_KEY, MQTT_SKIP_CERT_VAL_KEY, CALLBACK_SKIP_CERT_VAL_KEY,
+        DELIVERY_BLOCKED_KEY, NVS_WRITES_KEY
+    };
+    preferences.begin(PREFERENCES_NAMESPACE, false);
+    for (const char* key : keys) {
+        if (preferences.isKey(key)) {
+            preferences.remove(key);
+        }
+    }
     preferences.end();
 }
 
+// Marks the settings dirty; the persistence task writes them after COALESCE_MS
 void ConfigManager::save() {
     if (!_config.oneTimeOpening) {
         deliveryBlocked = false;
     }
-    preferences.begin(PREFERENCES_NAMESPACE, false);
-    preferences.putString(SSID_KEY, _config.ssid);
-    preferences.putString(PASSWORD_KEY, _config.password);
-    preferences.putString(OWNER_CODE_KEY, _config.ownerCodes);
-    preferences.putString(DELIVERY_CODE_KEY, _config.deliveryCodes);
-    preferences.putString(MQTT_SERVER_KEY, _config.mqttServer);
-    preferences.putInt(MQTT_PORT_KEY, _config.mqttPort);
-    preferences.putString(MQTT_USER_KEY, _config.mqttUser);
-    preferences.putString(MQTT_PASSWORD_KEY, _config.mqttPassword);
-    preferences.putInt(DUTY_CYCLE_OPEN_KEY, _config.dutyCycleOpen);
-    preferences.putInt(DUTY_CYCLE_CLOSE_KEY, _config.dutyCycleClose);
-    preferences.putString(SELECTED_MELODY_KEY, _config.selectedMelody);
-    preferences.putString(CALLBACK_URL_KEY, _config.callbackUrl);
-    preferences.putBool(AUTOLOCK_KEY, _config.autolock);
-    preferences.putString(ONE_TIME_CODES_KEY, _config.oneTimeCodes);
-    preferences.putBool(ONE_TIME_OPENING_KEY, _config.oneTimeOpening);
-    preferences.putBool(MQTT_USE_TLS_KEY, _config.mqttUseTls);
-    preferences.putBool(MQTT_SKIP_CERT_VAL_KEY, _config.mqttSkipCertVal);
-    preferences.putBool(CALLBACK_SKIP_CERT_VAL_KEY, _config.callbackSkipCertVal);
-    preferences.putBool(DELIVERY_BLOCKED_KEY, deliveryBlocked);
-    preferences.end();
+    _dirty = true;
+    if (_persistTask) {
+        xTaskNotifyGive(_persistTask);
+    } else {
+        flush();
+    }
+}
+
+bool ConfigManager::flush() {
+    if (_persistMutex) {
+        xSemaphoreTake(_persistMutex, portMAX_DELAY);
+    }
+    bool ok = true;
+    if (_dirty) {
+        _dirty = false;
+        // Work on a snapshot so a change made while writing stays dirty
+        ConfigSnapshot snapshot;
+        memset(&snapshot, 0, sizeof(snapshot));
+        snapshot.config = _config;
+        snapshot.deliveryBlocked = deliveryBlocked;
+
+        bool changed = diffConfig(snapshot.config, _persisted) != 0 || snapshot.deliveryBlocked != _persistedDeliveryBlocked ||
+                       _sequence == 0;
+        if (changed) {
+            uint8_t slot = _activeSlot ^ 1;
+            snapshot.magic = CONFIG_MAGIC;
+            snapshot.version = CONFIG_VERSION;
+            snapshot.size = sizeof(ConfigSnapshot);
+            snapshot.sequence = _sequence + 1;
+            snapshot.nvsWrites = _nvsWritesTotal + 1;
+            snapshot.crc = snapshotCrc(snapshot);
+
+            preferences.begin(PREFERENCES_NAMESPACE, false);
+            ok = preferences.putBytes(CONFIG_SLOT_KEYS[slot], &snapshot, sizeof(snapshot)) == sizeof(snapshot);
+            preferences.end();
+
+            if (ok) {
+                _activeSlot = slot;
+                _sequence = snapshot.sequence;
+                _nvsWritesTotal++;
+                _nvsWritesBoot++;
+                _persisted = snapshot.config;
+                _persistedDeliveryBlocked = snapshot.deliveryBlocked;
+                Serial.printf("Configuration persisted to %s (sequence %u)\n", CONFIG_SLOT_KEYS[slot], (unsigned)_sequence);
+            } else {
+                _dirty = true;
+                Serial.println("Error writing configuration snapshot");
+            }
+        }
+        _flushCount++;
+    }
+    if (_persistMutex) {
+        xSemaphoreGive(_persistMutex);
+    }
+    return ok;
+}
+
+void ConfigManager::persistTask(void* param) {
+    ConfigManager* self = static_cast<ConfigManager*>(param);
+    for (;;) {
+        // A write that failed is still dirty; retry it without waiting for another save()
+        ulTaskNotifyTake(pdTRUE, self->_dirty ? pdMS_TO_TICKS(RETRY_MS) : portMAX_DELAY);
+        // Coalesce: keep waiting while further saves arrive within the window,
+        // but flush MAX_COALESCE_MS after the first one at the latest
+        TickType_t start = xTaskGetTickCount();
+        for (;;) {
+            TickType_t elapsed = xTaskGetTickCount() - start;
+            if (elapsed >= pdMS_TO_TICKS(MAX_COALESCE_MS)) {
+                break;
+            }
+            TickType_t wait = pdMS_TO_TICKS(MAX_COALESCE_MS) - elapsed;
+            if (wait > pdMS_TO_TICKS(COALESCE_MS)) {
+                wait = pdMS_TO_TICKS(COALESCE_MS);
+            }
+            if (ulTaskNotifyTake(pdTRUE, wait) == 0) {
+                break;
+            }
+        }
+        self->flush();
+        self->compactIfRequested();
+    }
+}
+
+void ConfigManager::lockCredentials() const {
+    if (_credentialMutex) {
+        xSemaphoreTake(_credentialMutex, portMAX_DELAY);
+    }
+}
+
+void ConfigManager::unlockCredentials() const {
+    if (_credentialMutex) {
+        xSemaphoreGive(_credentialMutex);
+    }
+}
+
+void ConfigManager::requestCompaction() {
+    _compactRequested = true;
+    if (_persistTask) {
+        xTaskNotifyGive(_persistTask);
+    }
+}
+
+void ConfigManager::compactIfRequested() {
+    if (!_compactRequested) {
+        return;
+    }
+    lockCredentials();
+    _compactRequested = false;
+    if (_pendingCredentialChanges >= COMPACT_AFTER) {
+        compactCredentialJournal();
+    }
+    if (_pendingRedemptions >= COMPACT_AFTER) {
+        compactOneTimeCodes();
+    }
+    unlockCredentials();
+}
+
+static String quarantinePath(const char* path) {
+    return String(path) + ".bad";
 }
 
 void ConfigManager::factoryReset() {
+    if (_persistMutex) {
+        xSemaphoreTake(_persistMutex, portMAX_DELAY);
+    }
+    _dirty = false;
     preferences.begin(PREFERENCES_NAMESPACE, false);
     preferences.clear();
+    // Flash wear survives a factory reset, so does its counter
+    preferences.putUInt(NVS_WRITES_KEY, _nvsWritesTotal);
     preferences.end();
+    if (_persistMutex) {
+        xSemaphoreGive(_persistMutex);
+    }
+    LittleFS.remove(CREDENTIALS_PATH);
+    LittleFS.remove(CREDENTIALS_JOURNAL_PATH);
+    LittleFS.remove(quarantinePath(CREDENTIALS_PATH).c_str());
+    LittleFS.remove(quarantinePath(CREDENTIALS_JOURNAL_PATH).c_str());
+    LittleFS.remove(ONE_TIME_LOG_PATH);
+    LittleFS.remove(WEBHOOKS_PATH);
     Serial.println("All preferences cleared.");
     load();
 }
 
+uint32_t ConfigManager::update(const Config& next) {
+    uint32_t changes = diffConfig(next, _config);
+    _config = next;
+    save();
+    Serial.printf("Configuration updated, changed groups: 0x%02X\n", (unsigned)changes);
+    notify(changes);
+    return changes;
+}
+
+void ConfigManager::addListener(uint32_t mask, ConfigListener listener) {
+    if (_listenerCount < MAX_LISTENERS) {
+        _listeners[_listenerCount].mask = mask;
+        _listeners[_listenerCount].listener = listener;
+        _listenerCount++;
+    }
+}
+
+void ConfigManager::notify(uint32_t changes) {
+    for (uint8_t i = 0; i < _listenerCount; i++) {
+        if (_listeners[i].mask & changes) {
+            _listeners[i].listener(changes);
+        }
+    }
+}
+
 void ConfigManager::resetDeliveryBlockIfNeeded(const char* requester) {
     if (deliveryBlocked) {
         deliveryBlocked = false;
+        save();
+        Serial.printf("Delivery block reset by owner (%s)\n", requester);
+    }
+}
+
+std::shared_ptr<const CredentialIndex> ConfigManager::getCredentials() const {
+    if (!_snapshotMutex) {
+        return _credentials;
+    }
+    xSemaphoreTake(_snapshotMutex, portMAX_DELAY);
+    std::shared_ptr<const CredentialIndex> credentials = _credentials;
+    xSemaphoreGive(_snapshotMutex);
+    return credentials;
+}
+
+// Called with the credential mutex held. The previous index is freed once the
+// last reader lets go of it, so only one copy stays allocated between edits.
+void ConfigManager::publishCredentials(std::shared_ptr<const CredentialIndex> credentials) {
+    if (_snapshotMutex) {
+        xSemaphoreTake(_snapshotMutex, portMAX_DELAY);
+    }
+    _credentials.swap(credentials);
+    if (_snapshotMutex) {
+        xSemaphoreGive(_snapshotMutex);
+    }
+}
+
+void ConfigManager::loadCredentials() {
+    unsigned long start = millis();
+    std::shared_ptr<CredentialIndex> access = std::make_shared<CredentialIndex>();
+    CredentialIndex oneTime;
+    uint32_t listId = 0;
+    _credentialFileStatus = CredentialStore::load(littleFsStorage, CREDENTIALS_PATH, *access, oneTime, listId);
+    if (_credentialFileStatus == CredentialFileStatus::MISSING) {
+        migrateLegacyCodes();
+        _credentialsQuarantined = LittleFS.exists(quarantinePath(CREDENTIALS_PATH).c_str());
+        return;
+    }
+    if (_credentialFileStatus != CredentialFileStatus::OK) {
+        quarantineCredentials();
+        return;
+    }
+    _pendingCredentialChanges = CredentialStore::replayChanges(littleFsStorage, CREDENTIALS_JOURNAL_PATH, *access);
+    if (_pendingCredentialChanges > 0) {
+        access->compactLabels();
+    }
+    publishCredentials(access);
+    _oneTimeCodes.assign(std::move(oneTime), listId);
+    replayRedemptionLog();
+    Serial.printf("Credentials loaded: %u access codes, %u one-time codes in %lu ms\n",
+                  (unsigned)access->size(), (unsigned)_oneTimeCodes.size(), millis() - start);
+    if (_pendingCredentialChanges >= COMPACT_AFTER) {
+        compactCredentialJournal();
+    }
+}
+
+// A damaged file, or one of another firmware version, is never overwritten:
+// it is set aside together with its journal, and the box starts without codes.
+// Codes added after that go to a new journal, which the next boot replays on
+// top of the (then missing) file before writing a fresh one.
+void ConfigManager::quarantineCredentials() {
+    const char* const paths[] = { CREDENTIALS_PATH, CREDENTIALS_JOURNAL_PATH };
+    for (const char* path : paths) {
+        String target = quarantinePath(path);
+        LittleFS.remove(target.c_str());
+        if (LittleFS.exists(path) && !LittleFS.rename(path, target.c_str())) {
+            Serial.printf("Error moving %s aside\n", path);
+        }
+    }
+    _credentialsQuarantined = true;
+    Serial.printf("Credential file %s, moved to %s; starting without stored codes\n",
+                  CredentialStore::statusName(_credentialFileStatus), quarantinePath(CREDENTIALS_PATH).c_str());
+}
+
+// Moves code lists from the NVS JSON strings used by earlier firmware into the credential file
+void ConfigManager::migrateLegacyCodes() {
+    preferences.begin(PREFERENCES_NAMESPACE, false);
+    String ownerCodes = preferences.getString(OWNER_CODE_KEY, "[]");
+    String deliveryCodes = preferences.getString(DELIVERY_CODE_KEY, "[]");
+    String oneTimeCodes = preferences.getString(ONE_TIME_CODES_KEY, "[]");
+    preferences.end();
+
+    std::shared_ptr<CredentialIndex> access = std::make_shared<CredentialIndex>();
+    access->addJson(ownerCodes.c_str(), CredentialGroup::OWNER);
+    access->addJson(deliveryCodes.c_str(), CredentialGroup::DELIVERY);
+    access->finalize();
+    // Codes added through the API after a quarantine, or before a file was ever written, are only in the journal
+    _pendingCredentialChanges = CredentialStore::replayChanges(littleFsStorage, CREDENTIALS_JOURNAL_PATH, *access);
+    access->compactLabels();
+    publishCredentials(access);
+
+    if (!_oneTimeCodes.load(oneTimeCodes.c_str(), _oneTimeCodes.listId() + 1)) {
+        Serial.println("Error parsing one-time codes JSON");
+    }
+    LittleFS.remove(ONE_TIME_LOG_PATH);
+    _pendingRedemptions = 0;
+
+    if (persistCredentials()) {
         preferences.begin(PREFERENCES_NAMESPACE, false);
-        preferences.putBool(DELIVERY_BLOCKED_KEY, false);
+        preferences.remove(OWNER_CODE_KEY);
+        preferences.remove(DELIVERY_CODE_KEY);
+        preferences.remove(ONE_TIME_CODES_KEY);
         preferences.end();
-        Serial.printf("Delivery block reset by owner (%s)\n", requester);
+        Serial.printf("Migrated %u access codes and %u one-time codes to %s\n",
+                      (unsigned)access->size(), (unsigned)_oneTimeCodes.size(), CREDENTIALS_PATH);
     }
 }
 
-bool ConfigManager::checkAndRedeemOneTimeCode(const char* scannedCode, String& labelOut) {
-    if (_config.oneTimeCodes.length() == 0 || _config.oneTimeCodes == "[]") {
+bool ConfigManager::persistCredentials() {
+    if (!CredentialStore::save(littleFsStorage, CREDENTIALS_PATH, *_credentials, _oneTimeCodes.codes(), _oneTimeCodes.listId())) {
+        Serial.println("Error writing credential file");
         return false;
     }
-    JsonDocument doc;
-    DeserializationError error = deserializeJson(doc, _config.oneTimeCodes);
-    if (error) {
+    // The file now contains every journaled change
+    LittleFS.remove(CREDENTIALS_JOURNAL_PATH);
+    _pendingCredentialChanges = 0;
+    return true;
+}
+
+bool ConfigManager::setOneTimeCodes(const char* oneTimeCodesJson) {
+    lockCredentials();
+    // The list from the web UI already carries the redemptions it was shown
+    if (!_oneTimeCodes.load(oneTimeCodesJson, _oneTimeCodes.listId() + 1)) {
+        unlockCredentials();
         Serial.println("Error parsing one-time codes JSON");
         return false;
     }
+    LittleFS.remove(ONE_TIME_LOG_PATH);
+    _pendingRedemptions = 0;
+    bool ok = persistCredentials();
+    unlockCredentials();
+    return ok;
+}
 
-    // Convert scanned HEX code to its decimal representation
-    char scannedCodeDec[32] = "";
-    unsigned long val = strtoul(scannedCode, nullptr, 16);
-    snprintf(scannedCodeDec, sizeof(scannedCodeDec), "%lu", val);
-
-    JsonArray array = doc.as<JsonArray>();
-    bool found = false;
-    for (JsonObject obj : array) {
-        const char* code = obj["code"];
-        bool redeemed = obj["redeemed"] | false;
-        if (code && (strcmp(code, scannedCode) == 0 || strcmp(code, scannedCodeDec) == 0)) {
-            if (redeemed) {
-                Serial.println("One-time code matched but already redeemed.");
-                return false;
-            }
-            
-            // Found an active code! Now check if we are delivery blocked.
-            if (_config.oneTimeOpening && deliveryBlocked) {
-                Serial.println("Access denied: One-time opening active and delivery blocked. Code NOT redeemed.");
-                return false; // Keep code active!
-            }
-            
-            labelOut = obj["label"] | "One-Time Code";
-            obj["redeemed"] = true;
-            obj["redeemedAt"] = millis(); // Store redemption timestamp
-            found = true;
-            break;
+CredentialUpdate ConfigManager::addCredential(CredentialGroup group, const char* code, const char* label) {
+    lockCredentials();
+    CredentialUpdate result = changeCredential(CredentialStore::CHANGE_UPSERT, group, code, label);
+    unlockCredentials();
+    return result;
+}
+
+CredentialUpdate ConfigManager::removeCredential(CredentialGroup group, const char* code) {
+    lockCredentials();
+    CredentialUpdate result = changeCredential(CredentialStore::CHANGE_ERASE, group, code, nullptr);
+    unlockCredentials();
+    return result;
+}
+
+// Edits a copy and only publishes it once the change is journaled. The copy
+// leaves out labels earlier edits replaced, so the garbage never exceeds one edit.
+CredentialUpdate ConfigManager::changeCredential(uint8_t op, CredentialGroup group, const char* code, const char* label) {
+    std::shared_ptr<CredentialIndex> next = std::make_shared<CredentialIndex>();
+    next->assignCompacted(*_credentials, CredentialStore::MAX_CODE_LENGTH + CredentialStore::MAX_LABEL_LENGTH + 2);
+    if (!CredentialStore::applyChange(*next, op, group, code, label)) {
+        return CredentialUpdate::NOT_FOUND;
+    }
+    if (!CredentialStore::appendChange(littleFsStorage, CREDENTIALS_JOURNAL_PATH, op, group, code, label)) {
+        Serial.println("Error writing credential journal");
+        return CredentialUpdate::STORAGE_ERROR;
+    }
+    publishCredentials(next);
+    _pendingCredentialChanges++;
+    if (_pendingCredentialChanges >= COMPACT_AFTER) {
+        requestCompaction();
+    }
+    return CredentialUpdate::APPLIED;
+}
+
+// The published index is already compact (see changeCredential), so it is written as it is
+void ConfigManager::compactCredentialJournal() {
+    uint16_t folded = _pendingCredentialChanges;
+    if (persistCredentials()) {
+        Serial.printf("Credential journal compacted (%u changes folded in)\n", folded);
+    }
+}
+
+String ConfigManager::getOneTimeCodesJson() const {
+    std::string json;
+    lockCredentials();
+    _oneTimeCodes.toJson(json);
+    unlockCredentials();
+    return String(json.c_str());
+}
+
+void ConfigManager::replayRedemptionLog() {
+    _pendingRedemptions = CredentialStore::replayRedemptions(littleFsStorage, ONE_TIME_LOG_PATH, _oneTimeCodes);
+    if (_pendingRedemptions >= COMPACT_AFTER) {
+        compactOneTimeCodes();
+    }
+}
+
+void ConfigManager::appendRedemption(const RedemptionRecord& record) {
+    if (!CredentialStore::appendRedemption(littleFsStorage, ONE_TIME_LOG_PATH, record)) {
+        Serial.println("Error writing one-time code redemption log");
+        return;
+    }
+    _pendingRedemptions++;
+}
+
+void ConfigManager::compactOneTimeCodes() {
+    std::vector<size_t> changed = _oneTimeCodes.foldRedemptions();
+    // In place against the file as it is; a credential journal not folded in yet stays valid on top of it
+    if (!CredentialStore::updateOneTimeRecords(littleFsStorage, CREDENTIALS_PATH, _oneTimeCodes.codes(), _oneTimeCodes.listId(), changed)) {
+        Serial.println("Error updating one-time codes in place, rewriting credential file");
+        if (!persistCredentials()) {
+            return;
         }
     }
-    if (found) {
-        String updatedJson;
-        serializeJson(doc, updatedJson);
-        _config.oneTimeCodes = updatedJson;
-        
-        preferences.begin(PREFERENCES_NAMESPACE, false);
-        preferences.putString(ONE_TIME_CODES_KEY, _config.oneTimeCodes);
-        preferences.end();
-        Serial.printf("One-time code redeemed: %s\n", labelOut.c_str());
-        return true;
+    LittleFS.remove(ONE_TIME_LOG_PATH);
+    Serial.printf("One-time codes compacted (%u redemptions folded in)\n", _pendingRedemptions);
+    _pendingRedemptions = 0;
+}
+
+bool ConfigManager::checkAndRedeemOneTimeCode(const Credential& credential, char* labelOut, size_t labelSize) {
+    lockCredentials();
+    if (_oneTimeCodes.size() == 0) {
+        unlockCredentials();
+        return false;
+    }
+
+    const char* label = nullptr;
+    RedemptionRecord record;
+    bool blocked = _config.oneTimeOpening && deliveryBlocked;
+    RedeemResult result = _oneTimeCodes.redeem(credential, blocked, millis(), &label, &record);
+    if (result == RedeemResult::REDEEMED) {
+        snprintf(labelOut, labelSize, "%s", label ? label : "");
+        // Only the append happens here; folding the log into the file is left to the persistence task
+        appendRedemption(record);
+        if (_pendingRedemptions >= COMPACT_AFTER) {
+            requestCompaction();
+        }
+    }
+    unlockCredentials();
+
+    switch (result) {
+        case RedeemResult::ALREADY_REDEEMED:
+            Serial.println("One-time code matched but already redeemed.");
+            return false;
+        case RedeemResult::BLOCKED:
+            Serial.println("Access denied: One-time opening active and delivery blocked. Code NOT redeemed.");
+            return false; // Keep code active!
+        case RedeemResult::REDEEMED:
+            Serial.printf("One-time code redeemed: %s\n", labelOut);
+            return true;
+        default:
+            return false;
     }
-    return false;
 }
@@ -0,0 +1,332 @@
+#include "CredentialIndex.h"
+#include <ArduinoJson.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+// Only KEY_FLAGS take part in ordering; state flags such as FLAG_REDEEMED don't move records
+static bool recordLess(const CredentialRecord& a, const CredentialRecord& b) {
+    if (a.key != b.key) return a.key < b.key;
+    uint8_t flagsA = a.flags & CredentialIndex::KEY_FLAGS;
+    uint8_t flagsB = b.flags & CredentialIndex::KEY_FLAGS;
+    if (flagsA != flagsB) return flagsA < flagsB;
+    return a.group < b.group;
+}
+
+void CredentialIndex::clear() {
+    _records.clear();
+    _labels.clear();
+    _labelLookup.clear();
+}
+
+bool CredentialIndex::addJson(const char* codesJson, CredentialGroup group) {
+    if (!codesJson) {
+        return false;
+    }
+    JsonDocument doc;
+    DeserializationError error = deserializeJson(doc, codesJson);
+    if (error) {
+        return false;
+    }
+    uint16_t slot = 0;
+    for (JsonObject obj : doc.as<JsonArray>()) {
+        const char* code = obj["code"];
+        const char* label = obj["label"];
+        if (code) {
+            add(code, label, group, slot);
+        }
+        slot++;
+    }
+    return true;
+}
+
+void CredentialIndex::add(const char* code, const char* label, CredentialGroup group, uint16_t slot) {
+    CredentialRecord record;
+    record.flags = keyFor(code, record.key);
+    if (record.flags & FLAG_TEXT) {
+        record.label = appendText(label, code);
+    } else {
+        record.label = label ? internLabel(label) : NO_LABEL;
+    }
+    record.group = static_cast<uint8_t>(group);
+    record.slot = slot;
+    _records.push_back(record);
+}
+
+void CredentialIndex::finalize() {
+    std::sort(_records.begin(), _records.end(), recordLess);
+    _records.shrink_to_fit();
+    _labels.shrink_to_fit();
+    std::unordered_map<std::string, uint32_t>().swap(_labelLookup);
+}
+
+bool CredentialIndex::upsert(const char* code, const char* label, CredentialGroup group) {
+    CredentialRecord probe = { 0, 0, static_cast<uint8_t>(group), 0, 0 };
+    probe.flags = keyFor(code, probe.key);
+    size_t pos = position(probe, true);
+    bool exists = pos < _records.size() && !recordLess(probe, _records[pos]);
+
+    uint32_t offset = NO_LABEL;
+    if (probe.flags & FLAG_TEXT) {
+        offset = appendText(label, code);
+    } else if (label && *label) {
+        offset = _labels.size();
+        _labels.insert(_labels.end(), label, label + strlen(label) + 1);
+    }
+
+    if (exists) {
+        _records[pos].label = offset;
+        return false;
+    }
+
+    uint16_t slot = 0;
+    for (const CredentialRecord& record : _records) {
+        if (record.group == probe.group && record.slot >= slot) {
+            slot = record.slot + 1;
+        }
+    }
+    probe.label = offset;
+    probe.slot = slot;
+    _records.insert(_records.begin() + pos, probe);
+    return true;
+}
+
+bool CredentialIndex::erase(const char* code, CredentialGroup group) {
+    CredentialRecord probe = { 0, 0, static_cast<uint8_t>(group), 0, 0 };
+    probe.flags = keyFor(code, probe.key);
+    size_t pos = position(probe, true);
+    if (pos >= _records.size() || recordLess(probe, _records[pos])) {
+        return false;
+    }
+    _records.erase(_records.begin() + pos);
+    return true;
+}
+
+void CredentialIndex::compactLabels() {
+    std::vector<char> old;
+    old.swap(_labels);
+    relinkLabels(old);
+    _labels.shrink_to_fit();
+}
+
+void CredentialIndex::assignCompacted(const CredentialIndex& source, size_t spareLabelBytes) {
+    _records.clear();
+    _records.reserve(source._records.size() + 1);
+    _records.insert(_records.end(), source._records.begin(), source._records.end());
+    _labels.clear();
+    // The compacted pool is never larger than the source's
+    _labels.reserve(source._labels.size() + spareLabelBytes);
+    relinkLabels(source._labels);
+}
+
+// Points the records at copies of their labels in the (emptied) pool, interning shared ones
+void CredentialIndex::relinkLabels(const std::vector<char>& old) {
+    _labelLookup.clear();
+    for (CredentialRecord& record : _records) {
+        if (record.label == NO_LABEL || record.label >= old.size()) {
+            continue;
+        }
+        const char* text = &old[record.label];
+        if (record.flags & FLAG_TEXT) {
+            record.label = appendText(text, text + strlen(text) + 1);
+        } else {
+            record.label = internLabel(text);
+        }
+    }
+    std::unordered_map<std::string, uint32_t>().swap(_labelLookup);
+}
+
+uint32_t CredentialIndex::appendText(const char* label, const char* code) {
+    uint32_t offset = _labels.size();
+    const char* text = label ? label : "";
+    _labels.insert(_labels.end(), text, text + strlen(text) + 1);
+    _labels.insert(_labels.end(), code, code + strlen(code) + 1);
+    return offset;
+}
+
+uint32_t CredentialIndex::internLabel(const char* label) {
+    auto it = _labelLookup.find(label);
+    if (it != _labelLookup.end()) {
+        return it->second;
+    }
+    uint32_t offset = _labels.size();
+    _labels.insert(_labels.end(), label, label + strlen(label) + 1);
+    _labelLookup.emplace(label, offset);
+    return offset;
+}
+
+size_t CredentialIndex::count(CredentialGroup group) const {
+    size_t n = 0;
+    for (const CredentialRecord& record : _records) {
+        if (record.group == static_cast<uint8_t>(group)) {
+            n++;
+        }
+    }
+    return n;
+}
+
+size_t CredentialIndex::position(const CredentialRecord& probe, bool inclusive) const {
+    auto it = inclusive ? std::lower_bound(_records.begin(), _records.end(), probe, recordLess)
+                        : std::upper_bound(_records.begin(), _records.end(), probe, recordLess);
+    return it - _records.begin();
+}
+
+const CredentialRecord* CredentialIndex::findKey(uint64_t key, uint8_t flags) const {
+    CredentialRecord probe = { key, 0, 0, flags, 0 };
+    auto it = std::lower_bound(_records.begin(), _records.end(), probe, recordLess);
+    if (it != _records.end() && it->key == key && (it->flags & KEY_FLAGS) == flags) {
+        return &*it;
+    }
+    return nullptr;
+}
+
+const CredentialRecord* CredentialIndex::find(uint64_t value, uint8_t digits) const {
+    uint8_t zeros = 0;
+    if (digits > hexDigits(value)) {
+        zeros = (digits - hexDigits(value)) << ZEROS_SHIFT;
+    }
+    const CredentialRecord* best = findKey(value, zeros);
+
+    // A stored decimal code such as "123456" is keyed as 0x123456, so the
+    // scanned value is also looked up by its decimal digits read as hex.
+    uint64_t spelled;
+    if (decimalSpelling(value, spelled) && spelled != value) {
+        const CredentialRecord* dec = findKey(spelled, 0);
+        if (dec && (!best || dec->group < best->group)) {
+            best = dec;
+        }
+    }
+    return best;
+}
+
+const CredentialRecord* CredentialIndex::findText(const char* code) const {
+    return code ? findKey(hashText(code), FLAG_TEXT) : nullptr;
+}
+
+const CredentialRecord* CredentialIndex::findScanned(const char* scannedCode) const {
+    uint64_t value;
+    if (parseHex(scannedCode, value)) {
+        return find(value, strlen(scannedCode));
+    }
+    return findText(scannedCode);
+}
+
+const char* CredentialIndex::label(const CredentialRecord& record) const {
+    if (record.label == NO_LABEL || record.label >= _labels.size() || _labels[record.label] == '\0') {
+        return nullptr;
+    }
+    return &_labels[record.label];
+}
+
+void CredentialIndex::codeText(const CredentialRecord& record, char* out, size_t size) const {
+    if ((record.flags & FLAG_TEXT) && record.label < _labels.size()) {
+        const char* text = &_labels[record.label];
+        text += strlen(text) + 1;
+        strncpy(out, text, size - 1);
+        out[size - 1] = '\0';
+        return;
+    }
+    int zeros = (record.flags & ZEROS_MASK) >> ZEROS_SHIFT;
+    snprintf(out, size, "%0*llX", hexDigits(record.key) + zeros, (unsigned long long)record.key);
+}
+
+void CredentialIndex::assign(std::vector<CredentialRecord>&& records, std::vector<char>&& labels) {
+    _records = std::move(records);
+    _labels = std::move(labels);
+    _labelLookup.clear();
+}
+
+void CredentialIndex::toJson(CredentialGroup group, std::string& out, const std::vector<bool>* redeemedBySlot) const {
+    std::vector<const CredentialRecord*> ordered;
+    for (const CredentialRecord& record : _records) {
+        if (record.group == static_cast<uint8_t>(group)) {
+            ordered.push_back(&record);
+        }
+    }
+    std::sort(ordered.begin(), ordered.end(), [](const CredentialRecord* a, const CredentialRecord* b) {
+        return a->slot < b->slot;
+    });
+
+    JsonDocument doc;
+    JsonArray array = doc.to<JsonArray>();
+    char code[24];
+    for (const CredentialRecord* record : ordered) {
+        JsonObject obj = array.add<JsonObject>();
+        codeText(*record, code, sizeof(code));
+        obj["code"] = code;
+        const char* text = label(*record);
+        if (text) {
+            obj["label"] = text;
+        }
+        if (group == CredentialGroup::ONE_TIME) {
+            bool redeemed = (record->flags & FLAG_REDEEMED) != 0;
+            if (redeemedBySlot && record->slot < redeemedBySlot->size()) {
+                redeemed = (*redeemedBySlot)[record->slot];
+            }
+            obj["redeemed"] = redeemed;
+        }
+    }
+    out.clear();
+    serializeJson(doc, out);
+}
+
+bool CredentialIndex::parseHex(const char* text, uint64_t& value) {
+    if (!text || !*text) {
+        return false;
+    }
+    uint64_t result = 0;
+    size_t digits = 0;
+    for (const char* p = text; *p; ++p) {
+        char c = *p;
+        uint8_t nibble;
+        if (c >= '0' && c <= '9') nibble = c - '0';
+        else if (c >= 'A' && c <= 'F') nibble = c - 'A' + 10;
+        else if (c >= 'a' && c <= 'f') nibble = c - 'a' + 10;
+        else return false;
+        if (++digits > 16) return false;
+        result = (result << 4) | nibble;
+    }
+    value = result;
+    return true;
+}
+
+bool CredentialIndex::decimalSpelling(uint64_t value, uint64_t& spelledAsHex) {
+    uint64_t result = 0;
+    unsigned shift = 0;
+    do {
+        if (shift >= 64) {
+            return false;
+        }
+        result |= (value % 10) << shift;
+        shift += 4;
+        value /= 10;
+    } while (value != 0);
+    spelledAsHex = result;
+    return true;
+}
+
+uint8_t CredentialIndex::keyFor(const char* code, uint64_t& key) {
+    if (parseHex(code, key)) {
+        // At most 15, as parseHex takes no more than 16 digits
+        return (strlen(code) - hexDigits(key)) << ZEROS_SHIFT;
+    }
+    key = hashText(code);
+    return FLAG_TEXT;
+}
+
+uint8_t CredentialIndex::hexDigits(uint64_t value) {
+    uint8_t digits = 1;
+    while (value >>= 4) {
+        digits++;
+    }
+    return digits;
+}
+
+uint64_t CredentialIndex::hashText(const char* text) {
+    uint64_t hash = 1469598103934665603ULL;
+    for (const char* p = text; *p; ++p) {
+        hash ^= static_cast<uint8_t>(*p);
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
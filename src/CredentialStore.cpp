@@ -0,0 +1,260 @@
+#include "CredentialStore.h"
+#include "Crc32.h"
+#include <cstring>
+#include <string>
+
+static uint32_t crcOfRecords(uint32_t crc, const CredentialIndex& index) {
+    crc = crc32Update(crc, index.records().data(), index.records().size() * sizeof(CredentialRecord));
+    return crc32Update(crc, index.labels().data(), index.labels().size());
+}
+
+static bool readExactly(StorageFile& file, void* data, size_t length) {
+    return length == 0 || file.read(data, length) == length;
+}
+
+static bool writeExactly(StorageFile& file, const void* data, size_t length) {
+    return length == 0 || file.write(data, length) == length;
+}
+
+static uint64_t fileSizeOf(const CredentialFileHeader& header) {
+    return sizeof(header) + (static_cast<uint64_t>(header.accessCount) + header.oneTimeCount) * sizeof(CredentialRecord) +
+           header.accessLabelBytes + header.oneTimeLabelBytes;
+}
+
+static bool readSection(StorageFile& file, uint32_t count, uint32_t labelBytes, CredentialIndex& index, uint32_t& crc) {
+    std::vector<CredentialRecord> records(count);
+    std::vector<char> labels(labelBytes);
+    if (!readExactly(file, records.data(), count * sizeof(CredentialRecord)) || !readExactly(file, labels.data(), labelBytes)) {
+        return false;
+    }
+    crc = crc32Update(crc, records.data(), count * sizeof(CredentialRecord));
+    crc = crc32Update(crc, labels.data(), labelBytes);
+    index.assign(std::move(records), std::move(labels));
+    return true;
+}
+
+// Reads length bytes in small chunks and adds them to both CRCs
+static bool crcOfFile(StorageFile& file, size_t length, uint32_t& crcA, uint32_t& crcB) {
+    uint8_t buffer[256];
+    while (length > 0) {
+        size_t n = length < sizeof(buffer) ? length : sizeof(buffer);
+        if (!readExactly(file, buffer, n)) {
+            return false;
+        }
+        crcA = crc32Update(crcA, buffer, n);
+        crcB = crc32Update(crcB, buffer, n);
+        length -= n;
+    }
+    return true;
+}
+
+CredentialFileHeader CredentialStore::headerFor(const CredentialIndex& access, const CredentialIndex& oneTime, uint32_t oneTimeListId) {
+    CredentialFileHeader header;
+    header.magic = MAGIC;
+    header.version = VERSION;
+    header.recordSize = sizeof(CredentialRecord);
+    header.oneTimeListId = oneTimeListId;
+    header.accessCount = access.records().size();
+    header.accessLabelBytes = access.labels().size();
+    header.oneTimeCount = oneTime.records().size();
+    header.oneTimeLabelBytes = oneTime.labels().size();
+
+    uint32_t crc = crc32Update(0, &header, offsetof(CredentialFileHeader, crc));
+    crc = crcOfRecords(crc, access);
+    header.crc = crcOfRecords(crc, oneTime);
+    return header;
+}
+
+CredentialFileStatus CredentialStore::load(Storage& storage, const char* path, CredentialIndex& access, CredentialIndex& oneTime, uint32_t& oneTimeListId) {
+    if (!storage.exists(path)) {
+        return CredentialFileStatus::MISSING;
+    }
+    std::unique_ptr<StorageFile> file = storage.open(path, "r");
+    if (!file) {
+        return CredentialFileStatus::CORRUPT;
+    }
+
+    CredentialFileHeader header;
+    if (!readExactly(*file, &header, sizeof(header)) || header.magic != MAGIC) {
+        return CredentialFileStatus::CORRUPT;
+    }
+    if (header.version != VERSION || header.recordSize != sizeof(CredentialRecord)) {
+        return CredentialFileStatus::UNSUPPORTED;
+    }
+    // Sections are allocated from these fields before the CRC can be checked
+    if (header.accessCount > MAX_RECORDS || header.oneTimeCount > MAX_RECORDS ||
+        header.accessLabelBytes > MAX_LABEL_BYTES || header.oneTimeLabelBytes > MAX_LABEL_BYTES ||
+        fileSizeOf(header) != file->size()) {
+        return CredentialFileStatus::CORRUPT;
+    }
+
+    uint32_t crc = crc32Update(0, &header, offsetof(CredentialFileHeader, crc));
+    CredentialIndex loadedAccess;
+    CredentialIndex loadedOneTime;
+    bool ok = readSection(*file, header.accessCount, header.accessLabelBytes, loadedAccess, crc) &&
+              readSection(*file, header.oneTimeCount, header.oneTimeLabelBytes, loadedOneTime, crc);
+    if (!ok || crc != header.crc) {
+        return CredentialFileStatus::CORRUPT;
+    }
+
+    access = std::move(loadedAccess);
+    oneTime = std::move(loadedOneTime);
+    oneTimeListId = header.oneTimeListId;
+    return CredentialFileStatus::OK;
+}
+
+const char* CredentialStore::statusName(CredentialFileStatus status) {
+    switch (status) {
+        case CredentialFileStatus::OK: return "ok";
+        case CredentialFileStatus::MISSING: return "missing";
+        case CredentialFileStatus::CORRUPT: return "corrupt";
+        case CredentialFileStatus::UNSUPPORTED: return "unsupported";
+        default: return "unknown";
+    }
+}
+
+bool CredentialStore::save(Storage& storage, const char* path, const CredentialIndex& access, const CredentialIndex& oneTime, uint32_t oneTimeListId) {
+    std::string tempPath = std::string(path) + ".tmp";
+    std::unique_ptr<StorageFile> file = storage.open(tempPath.c_str(), "w");
+    if (!file) {
+        return false;
+    }
+
+    CredentialFileHeader header = headerFor(access, oneTime, oneTimeListId);
+    bool ok = writeExactly(*file, &header, sizeof(header)) &&
+              writeExactly(*file, access.records().data(), access.records().size() * sizeof(CredentialRecord)) &&
+              writeExactly(*file, access.labels().data(), access.labels().size()) &&
+              writeExactly(*file, oneTime.records().data(), oneTime.records().size() * sizeof(CredentialRecord)) &&
+              writeExactly(*file, oneTime.labels().data(), oneTime.labels().size());
+    file.reset();
+
+    if (!ok || !storage.rename(tempPath.c_str(), path)) {
+        storage.remove(tempPath.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool CredentialStore::updateOneTimeRecords(Storage& storage, const char* path, const CredentialIndex& oneTime, uint32_t oneTimeListId, const std::vector<size_t>& positions) {
+    if (positions.empty()) {
+        return true;
+    }
+    std::unique_ptr<StorageFile> file = storage.open(path, "r+");
+    if (!file) {
+        return false;
+    }
+
+    CredentialFileHeader header;
+    if (!readExactly(*file, &header, sizeof(header)) || header.magic != MAGIC || fileSizeOf(header) != file->size() ||
+        header.oneTimeListId != oneTimeListId || header.oneTimeCount != oneTime.records().size() ||
+        header.oneTimeLabelBytes != oneTime.labels().size()) {
+        return false;
+    }
+
+    // One pass over the file checks its CRC and computes the one after the update
+    uint32_t oldCrc = crc32Update(0, &header, offsetof(CredentialFileHeader, crc));
+    uint32_t newCrc = oldCrc;
+    if (!crcOfFile(*file, header.accessCount * sizeof(CredentialRecord) + header.accessLabelBytes, oldCrc, newCrc)) {
+        return false;
+    }
+    const std::vector<CredentialRecord>& records = oneTime.records();
+    auto next = positions.begin();
+    CredentialRecord record;
+    for (size_t i = 0; i < records.size(); i++) {
+        if (!readExactly(*file, &record, sizeof(record))) {
+            return false;
+        }
+        oldCrc = crc32Update(oldCrc, &record, sizeof(record));
+        if (next != positions.end() && *next == i) {
+            record = records[i];
+            ++next;
+        }
+        newCrc = crc32Update(newCrc, &record, sizeof(record));
+    }
+    if (!crcOfFile(*file, header.oneTimeLabelBytes, oldCrc, newCrc) || oldCrc != header.crc) {
+        return false;
+    }
+
+    size_t base = sizeof(header) + header.accessCount * sizeof(CredentialRecord) + header.accessLabelBytes;
+    bool ok = true;
+    for (size_t position : positions) {
+        ok = ok && position < records.size() && file->seek(base + position * sizeof(CredentialRecord)) &&
+             writeExactly(*file, &records[position], sizeof(CredentialRecord));
+    }
+    header.crc = newCrc;
+    return ok && file->seek(0) && writeExactly(*file, &header, sizeof(header));
+}
+
+bool CredentialStore::appendChange(Storage& storage, const char* journalPath, uint8_t op, CredentialGroup group, const char* code, const char* label) {
+    size_t codeLength = strlen(code);
+    size_t labelLength = label ? strlen(label) : 0;
+    if (codeLength == 0 || codeLength > MAX_CODE_LENGTH || labelLength > MAX_LABEL_LENGTH) {
+        return false;
+    }
+    std::unique_ptr<StorageFile> journal = storage.open(journalPath, "a");
+    if (!journal) {
+        return false;
+    }
+    CredentialChange change = { op, static_cast<uint8_t>(group), static_cast<uint8_t>(codeLength), static_cast<uint8_t>(labelLength) };
+    return writeExactly(*journal, &change, sizeof(change)) &&
+           writeExactly(*journal, code, codeLength) &&
+           writeExactly(*journal, label, labelLength);
+}
+
+size_t CredentialStore::replayChanges(Storage& storage, const char* journalPath, CredentialIndex& access) {
+    if (!storage.exists(journalPath)) {
+        return 0;
+    }
+    std::unique_ptr<StorageFile> journal = storage.open(journalPath, "r");
+    if (!journal) {
+        return 0;
+    }
+    size_t replayed = 0;
+    CredentialChange change;
+    char code[MAX_CODE_LENGTH + 1];
+    char label[MAX_LABEL_LENGTH + 1];
+    // A torn entry at the end is the one the last power loss interrupted; it was never acknowledged
+    while (readExactly(*journal, &change, sizeof(change))) {
+        if (change.codeLength == 0 || change.codeLength > MAX_CODE_LENGTH || change.labelLength > MAX_LABEL_LENGTH ||
+            !readExactly(*journal, code, change.codeLength) || !readExactly(*journal, label, change.labelLength)) {
+            break;
+        }
+        code[change.codeLength] = '\0';
+        label[change.labelLength] = '\0';
+        applyChange(access, change.op, static_cast<CredentialGroup>(change.group), code, label);
+        replayed++;
+    }
+    return replayed;
+}
+
+bool CredentialStore::applyChange(CredentialIndex& access, uint8_t op, CredentialGroup group, const char* code, const char* label) {
+    if (op == CHANGE_UPSERT) {
+        access.upsert(code, label, group);
+        return true;
+    }
+    return op == CHANGE_ERASE && access.erase(code, group);
+}
+
+bool CredentialStore::appendRedemption(Storage& storage, const char* logPath, const RedemptionRecord& record) {
+    std::unique_ptr<StorageFile> log = storage.open(logPath, "a");
+    return log && writeExactly(*log, &record, sizeof(record));
+}
+
+size_t CredentialStore::replayRedemptions(Storage& storage, const char* logPath, OneTimeCodeStore& oneTime) {
+    if (!storage.exists(logPath)) {
+        return 0;
+    }
+    std::unique_ptr<StorageFile> log = storage.open(logPath, "r");
+    if (!log) {
+        return 0;
+    }
+    size_t applied = 0;
+    RedemptionRecord record;
+    // Records of a replaced list are skipped by apply(); a torn record at the end was never acknowledged
+    while (readExactly(*log, &record, sizeof(record))) {
+        if (oneTime.apply(record)) {
+            applied++;
+        }
+    }
+    return applied;
+}
@@ -0,0 +1,236 @@
+#include "Diagnostics.h"
+#include "ConfigManager.h"
+#include "MailboxNetworkManager.h"
+#include "WifiSupervisor.h"
+#include "HeapMonitor.h"
+#include "BootTimeline.h"
+#include "WebhookDispatcher.h"
+#include "MqttManager.h"
+#include <WiFi.h>
+#include <ArduinoJson.h>
+
+#ifndef FIRMWARE_VERSION
+#define FIRMWARE_VERSION "local-dev"
+#endif
+
+Diagnostics diagnostics;
+
+void Diagnostics::begin() {
+    _mutex = xSemaphoreCreateMutex();
+    // A cached ETag from before a restart must not match the new generation 0
+    _bootId = esp_random();
+    _state = capture(millis());
+}
+
+void Diagnostics::update() {
+    consumeWifiScan();
+    DiagnosticsState state = capture(millis());
+    if (memcmp(&state, &_state, sizeof(state)) == 0) {
+        return;
+    }
+    xSemaphoreTake(_mutex, portMAX_DELAY);
+    _state = state;
+    _generation++;
+    xSemaphoreGive(_mutex);
+}
+
+void Diagnostics::consumeWifiScan() {
+    int16_t status = WiFi.scanComplete();
+    if (status < 0) {
+        return;
+    }
+    JsonDocument wifiDoc;
+    JsonArray networks = wifiDoc.to<JsonArray>();
+    for (int i = 0; i < status; ++i) {
+        JsonObject net = networks.add<JsonObject>();
+        net["ssid"] = WiFi.SSID(i);
+        net["rssi"] = WiFi.RSSI(i);
+        net["secure"] = WiFi.encryptionType(i) != WIFI_AUTH_OPEN;
+    }
+    WiFi.scanDelete();
+    std::string json;
+    serializeJson(wifiDoc, json);
+
+    xSemaphoreTake(_mutex, portMAX_DELAY);
+    _wifiNetworksJson = std::move(json);
+    _wifiScanGeneration++;
+    xSemaphoreGive(_mutex);
+}
+
+DiagnosticsState Diagnostics::capture(unsigned long now) {
+    // Zeroed first so padding bytes compare equal in update()
+    DiagnosticsState state;
+    memset(&state, 0, sizeof(state));
+    state.live = EventStream::capture();
+    state.nvsWritesTotal = configManager.nvsWritesTotal();
+    state.nvsWritesBoot = configManager.nvsWritesSinceBoot();
+    state.configFlushes = configManager.flushCount();
+    state.configLoadUs = configManager.configLoadMicros();
+    state.configPending = configManager.hasPendingWrites();
+    state.credentialFileStatus = static_cast<uint8_t>(configManager.credentialFileStatus());
+    state.credentialsQuarantined = configManager.credentialsQuarantined();
+    state.wifiSoftApActive = wifiSupervisor.softApActive();
+    state.wifiState = static_cast<uint8_t>(wifiSupervisor.state());
+    state.wifiChannel = wifiSupervisor.cache().channel;
+    memcpy(state.wifiBssid, wifiSupervisor.cache().bssid, sizeof(state.wifiBssid));
+    state.wifiReconnects = wifiSupervisor.reconnects();
+    state.wifiLastReconnectMs = wifiSupervisor.lastReconnectMs();
+    state.wifiMaxReconnectMs = wifiSupervisor.maxReconnectMs();
+    state.wifiFastConnects = wifiSupervisor.fastConnects();
+    state.wifiFailedAttempts = wifiSupervisor.failedAttempts();
+    state.assetResponses = mailboxNetworkManager.assetResponses();
+    state.assetNotModified = mailboxNetworkManager.assetNotModified();
+    state.eventClients = eventStream.clientCount();
+    state.eventsSent = eventStream.eventsSent();
+    state.webhookQueueDepth = webhookDispatcher.queueDepth();
+    state.webhookDelivered = webhookDispatcher.delivered();
+    state.webhookFailed = webhookDispatcher.failed();
+    state.webhookDropped = webhookDispatcher.dropped();
+    state.webhookRetries = webhookDispatcher.retries();
+    state.webhookLastLatencyMs = webhookDispatcher.lastLatencyMs();
+    state.webhookMaxLatencyMs = webhookDispatcher.maxLatencyMs();
+    state.mqttQueueDepth = mqttOutbox.size();
+    state.mqttQueueHighWater = mqttOutbox.highWater();
+    state.mqttQueueDropped = mqttOutbox.dropped();
+    state.mqttState = static_cast<uint8_t>(mqttManager.state());
+    state.mqttConnects = mqttManager.connects();
+    state.mqttConnectFailures = mqttManager.connectFailures();
+    state.mqttLastConnectMs = mqttManager.lastConnectMs();
+    state.mqttMaxConnectMs = mqttManager.maxConnectMs();
+    state.mqttJournalPending = mqttManager.journalPending();
+    state.mqttJournalDropped = mqttManager.journalDropped();
+    state.mqttReplayed = mqttManager.replayed();
+    state.bootPhasesReached = bootTimeline.reachedMask();
+    state.heapLargestBlockMin = heapMonitor.lowestLargestFreeBlock();
+    state.heapSamples = heapMonitor.sampleCount();
+    state.wifiScanGeneration = _wifiScanGeneration;
+
+    if (_lastSlowSample == 0 || now - _lastSlowSample >= SLOW_SAMPLE_MS) {
+        _lastSlowSample = now;
+        state.wifiRssi = WiFi.RSSI();
+        state.heapFree = ESP.getFreeHeap();
+        state.heapMinFree = ESP.getMinFreeHeap();
+        state.heapLargestBlock = heapMonitor.largestFreeBlock();
+    } else {
+        state.wifiRssi = _state.wifiRssi;
+        state.heapFree = _state.heapFree;
+        state.heapMinFree = _state.heapMinFree;
+        state.heapLargestBlock = _state.heapLargestBlock;
+    }
+    return state;
+}
+
+void Diagnostics::etag(char* out, size_t size) const {
+    formatEtag(_generation, out, size);
+}
+
+void Diagnostics::formatEtag(uint32_t generation, char* out, size_t size) const {
+    snprintf(out, size, "\"%08x-%u\"", (unsigned)_bootId, (unsigned)generation);
+}
+
+std::shared_ptr<const std::string> Diagnostics::snapshot(char* etagOut, size_t size) {
+    xSemaphoreTake(_mutex, portMAX_DELAY);
+    if (!_snapshot || _snapshotGeneration != _generation) {
+        _snapshot = std::make_shared<const std::string>(serialize(_state));
+        _snapshotGeneration = _generation;
+    }
+    std::shared_ptr<const std::string> snapshot = _snapshot;
+    formatEtag(_snapshotGeneration, etagOut, size);
+    xSemaphoreGive(_mutex);
+    return snapshot;
+}
+
+// Called with _mutex held
+std::string Diagnostics::serialize(const DiagnosticsState& state) const {
+    const LiveState& live = state.live;
+    char wiegandId[20] = "";
+    char lastCode[20] = "";
+    if (live.scannedValue != 0) {
+        snprintf(wiegandId, sizeof(wiegandId), "%llX", (unsigned long long)live.scannedValue);
+    }
+    if (live.keypadDigits != 0) {
+        snprintf(lastCode, sizeof(lastCode), "%0*llX", live.keypadDigits, (unsigned long long)live.keypadValue);
+    }
+
+    JsonDocument doc;
+    doc["wiegand_id"] = wiegandId;
+    doc["last_code"] = lastCode;
+    doc["scan_count"] = live.scanCount;
+    doc["firmware_version"] = FIRMWARE_VERSION;
+    doc["mailbox_state"] = mailboxStateName(live.mailboxState);
+    doc["closed_switch"] = live.closedSwitch;
+    doc["parcel_switch"] = live.parcelSwitch;
+    doc["mail_switch"] = live.mailSwitch;
+    doc["delivery_blocked"] = live.deliveryBlocked;
+    doc["one_time_opening"] = live.oneTimeOpening;
+    doc["wifi_scan_running"] = live.wifiScanRunning;
+    doc["calibration_active"] = live.calibrationActive;
+    doc["calibration_step"] = live.calibrationStep;
+    doc["calibration_candidate"] = live.calibrationCandidate;
+    doc["nvs_writes_total"] = state.nvsWritesTotal;
+    doc["nvs_writes_boot"] = state.nvsWritesBoot;
+    doc["config_flushes"] = state.configFlushes;
+    doc["config_pending"] = state.configPending;
+    doc["config_load_us"] = state.configLoadUs;
+    doc["credential_file"] = CredentialStore::statusName(static_cast<CredentialFileStatus>(state.credentialFileStatus));
+    doc["credential_file_quarantined"] = state.credentialsQuarantined;
+    doc["asset_responses"] = state.assetResponses;
+    doc["asset_not_modified"] = state.assetNotModified;
+    doc["event_clients"] = state.eventClients;
+    doc["events_sent"] = state.eventsSent;
+    doc["diagnostics_generation"] = _generation;
+    doc["webhook_queue_depth"] = state.webhookQueueDepth;
+    doc["webhook_delivered"] = state.webhookDelivered;
+    doc["webhook_failed"] = state.webhookFailed;
+    doc["webhook_dropped"] = state.webhookDropped;
+    doc["webhook_retries"] = state.webhookRetries;
+    doc["webhook_last_latency_ms"] = state.webhookLastLatencyMs;
+    doc["webhook_max_latency_ms"] = state.webhookMaxLatencyMs;
+    doc["mqtt_queue_depth"] = state.mqttQueueDepth;
+    doc["mqtt_queue_capacity"] = MqttOutbox::capacity();
+    doc["mqtt_queue_high_water"] = state.mqttQueueHighWater;
+    doc["mqtt_queue_dropped"] = state.mqttQueueDropped;
+    doc["mqtt_state"] = MqttSession::stateName(static_cast<MqttState>(state.mqttState));
+    doc["mqtt_connects"] = state.mqttConnects;
+    doc["mqtt_connect_failures"] = state.mqttConnectFailures;
+    doc["mqtt_last_connect_ms"] = state.mqttLastConnectMs;
+    doc["mqtt_max_connect_ms"] = state.mqttMaxConnectMs;
+    doc["mqtt_journal_pending"] = state.mqttJournalPending;
+    doc["mqtt_journal_dropped"] = state.mqttJournalDropped;
+    doc["mqtt_replayed"] = state.mqttReplayed;
+    doc["wifi_state"] = WifiSupervisor::stateName(static_cast<WifiState>(state.wifiState));
+    doc["wifi_softap_active"] = state.wifiSoftApActive;
+    doc["wifi_rssi"] = state.wifiRssi;
+    doc["wifi_channel"] = state.wifiChannel;
+    char bssid[18];
+    const uint8_t* mac = state.wifiBssid;
+    snprintf(bssid, sizeof(bssid), "%02X:%02X:%02X:%02X:%02X:%02X", mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+    doc["wifi_bssid"] = bssid;
+    doc["wifi_reconnects"] = state.wifiReconnects;
+    doc["wifi_last_reconnect_ms"] = state.wifiLastReconnectMs;
+    doc["wifi_max_reconnect_ms"] = state.wifiMaxReconnectMs;
+    doc["wifi_fast_connects"] = state.wifiFastConnects;
+    doc["wifi_failed_attempts"] = state.wifiFailedAttempts;
+    JsonObject bootPhases = doc["boot_phases"].to<JsonObject>();
+    for (uint8_t i = 0; i < static_cast<uint8_t>(BootPhase::COUNT); i++) {
+        BootPhase phase = static_cast<BootPhase>(i);
+        if (bootTimeline.reached(phase)) {
+            bootPhases[BootTimeline::name(phase)] = bootTimeline.at(phase);
+        }
+    }
+    doc["heap_free"] = state.heapFree;
+    doc["heap_min_free"] = state.heapMinFree;
+    doc["heap_largest_block"] = state.heapLargestBlock;
+    doc["heap_largest_block_min"] = state.heapLargestBlockMin;
+    uint32_t blocks[HeapMonitor::HISTORY_SIZE];
+    uint8_t blockCount = heapMonitor.history(blocks, HeapMonitor::HISTORY_SIZE);
+    JsonArray blockHistory = doc["heap_largest_block_history"].to<JsonArray>();
+    for (uint8_t i = 0; i < blockCount; i++) {
+        blockHistory.add(blocks[i]);
+    }
+    doc["wifi_networks"] = serialized(_wifiNetworksJson.c_str(), _wifiNetworksJson.size());
+
+    std::string json;
+    serializeJson(doc, json);
+    return json;
+}
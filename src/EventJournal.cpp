@@ -0,0 +1,191 @@
+#include "EventJournal.h"
+#include "Crc32.h"
+#include "config.h"
+#include <LittleFS.h>
+#include <cstddef>
+
+static uint32_t entryCrc(const JournalEntry& entry, const char* data) {
+    uint32_t crc = crc32Update(0, &entry, offsetof(JournalEntry, crc));
+    return crc32Update(crc, data, entry.length);
+}
+
+// False at the end of the file and for a torn or damaged entry
+static bool readEntry(File& file, JournalEntry& entry, char* data) {
+    return file.read(reinterpret_cast<uint8_t*>(&entry), sizeof(entry)) == sizeof(entry) &&
+           entry.length <= MqttOutbox::Message::CAPACITY &&
+           file.read(reinterpret_cast<uint8_t*>(data), entry.length) == entry.length &&
+           entry.crc == entryCrc(entry, data);
+}
+
+const char* EventJournal::segmentPath(uint8_t segment) {
+    return MQTT_JOURNAL_PATHS[segment];
+}
+
+void EventJournal::begin() {
+    uint32_t firstSeq[2] = {0, 0};
+    bool present[2];
+    for (uint8_t segment = 0; segment < 2; ++segment) {
+        present[segment] = scan(segment, firstSeq[segment]);
+    }
+    // Appends continue in the newer segment
+    if (present[0] && present[1]) {
+        _active = firstSeq[0] > firstSeq[1] ? 0 : 1;
+    } else {
+        _active = present[1] ? 1 : 0;
+    }
+    if (!empty()) {
+        Serial.printf("MQTT journal: %u message(s) waiting to be sent\n", (unsigned)pending());
+    }
+}
+
+bool EventJournal::scan(uint8_t segment, uint32_t& firstSeq) {
+    const char* path = segmentPath(segment);
+    if (!LittleFS.exists(path)) {
+        return false;
+    }
+    File file = LittleFS.open(path, "r");
+    if (!file) {
+        return false;
+    }
+    size_t fileBytes = file.size();
+    uint32_t entries = 0;
+    uint32_t validBytes = 0;
+    JournalEntry entry;
+    char data[MqttOutbox::Message::CAPACITY];
+    while (readEntry(file, entry, data)) {
+        if (entries == 0) {
+            firstSeq = entry.seq;
+        }
+        if (entry.seq >= _nextSeq) {
+            _nextSeq = entry.seq + 1;
+        }
+        entries++;
+        validBytes += sizeof(entry) + entry.length;
+    }
+    file.close();
+
+    if (entries == 0) {
+        LittleFS.remove(path);
+        return false;
+    }
+    // A torn entry at the end is the one the last power loss interrupted
+    if (validBytes < fileBytes) {
+        Serial.printf("MQTT journal %s: dropping %u damaged byte(s) at the end\n", path, (unsigned)(fileBytes - validBytes));
+        compact(segment, validBytes);
+    }
+    _segments[segment].entries = entries;
+    _segments[segment].bytes = validBytes;
+    return true;
+}
+
+void EventJournal::compact(uint8_t segment, uint32_t validBytes) {
+    // LittleFS files cannot be truncated through the Arduino API, so copy the valid prefix
+    String tmpPath = String(segmentPath(segment)) + ".tmp";
+    File in = LittleFS.open(segmentPath(segment), "r");
+    File out = LittleFS.open(tmpPath, "w");
+    if (!in || !out) {
+        return;
+    }
+    uint8_t buffer[128];
+    uint32_t remaining = validBytes;
+    bool ok = true;
+    while (remaining > 0 && ok) {
+        size_t chunk = remaining < sizeof(buffer) ? remaining : sizeof(buffer);
+        ok = in.read(buffer, chunk) == chunk && out.write(buffer, chunk) == chunk;
+        remaining -= chunk;
+    }
+    in.close();
+    out.close();
+    if (ok) {
+        LittleFS.rename(tmpPath, segmentPath(segment));
+    } else {
+        LittleFS.remove(tmpPath);
+    }
+}
+
+uint8_t EventJournal::oldest() const {
+    uint8_t older = 1 - _active;
+    return _segments[older].bytes > 0 ? older : _active;
+}
+
+void EventJournal::removeSegment(uint8_t segment) {
+    if (segment == oldest()) {
+        _readOffset = 0;
+        _peekedBytes = 0;
+    }
+    LittleFS.remove(segmentPath(segment));
+    _segments[segment].entries = 0;
+    _segments[segment].bytes = 0;
+}
+
+bool EventJournal::append(uint8_t kind, const char* data, size_t length) {
+    if (length > MqttOutbox::Message::CAPACITY) {
+        return false;
+    }
+    size_t entryBytes = sizeof(JournalEntry) + length;
+    if (_segments[_active].bytes > 0 && _segments[_active].bytes + entryBytes > SEGMENT_BYTES) {
+        uint8_t older = 1 - _active;
+        if (_segments[older].bytes > 0) {
+            Serial.printf("MQTT journal full, dropping %u oldest message(s)\n", (unsigned)_segments[older].entries);
+            _dropped += _segments[older].entries;
+            removeSegment(older);
+        }
+        _active = older;
+    }
+
+    JournalEntry entry = {};
+    entry.seq = _nextSeq;
+    entry.kind = kind;
+    entry.length = static_cast<uint16_t>(length);
+    entry.crc = entryCrc(entry, data);
+    File file = LittleFS.open(segmentPath(_active), "a");
+    if (!file) {
+        Serial.println("Error opening MQTT journal");
+        return false;
+    }
+    bool ok = file.write(reinterpret_cast<const uint8_t*>(&entry), sizeof(entry)) == sizeof(entry) &&
+              file.write(reinterpret_cast<const uint8_t*>(data), length) == length;
+    file.close();
+    if (!ok) {
+        return false;
+    }
+    _nextSeq++;
+    _segments[_active].entries++;
+    _segments[_active].bytes += entryBytes;
+    return true;
+}
+
+bool EventJournal::peek(MqttOutbox::Message& out) {
+    while (!empty()) {
+        uint8_t segment = oldest();
+        File file = LittleFS.open(segmentPath(segment), "r");
+        JournalEntry entry;
+        bool ok = file && file.seek(_readOffset) && readEntry(file, entry, out.data);
+        if (file) {
+            file.close();
+        }
+        if (ok) {
+            out.kind = entry.kind;
+            out.length = entry.length;
+            _peekedBytes = sizeof(entry) + entry.length;
+            return true;
+        }
+        // Unreadable despite the scan at boot; give up on the rest of the segment
+        Serial.printf("MQTT journal %s unreadable, dropping %u message(s)\n", segmentPath(segment), (unsigned)_segments[segment].entries);
+        _dropped += _segments[segment].entries;
+        removeSegment(segment);
+    }
+    return false;
+}
+
+void EventJournal::consume() {
+    if (_peekedBytes == 0) {
+        return;
+    }
+    uint8_t segment = oldest();
+    _readOffset += _peekedBytes;
+    _peekedBytes = 0;
+    if (--_segments[segment].entries == 0) {
+        removeSegment(segment);
+    }
+}
@@ -0,0 +1,121 @@
+#include "EventStream.h"
+#include "ConfigManager.h"
+#include "SwitchManager.h"
+#include "Diagnostics.h"
+#include <WiFi.h>
+#include <ArduinoJson.h>
+
+EventStream eventStream;
+
+void EventStream::begin(AsyncWebServer& server) {
+    _last = capture();
+    _events.onConnect([](AsyncEventSourceClient *client) {
+        // Runs on the AsyncTCP task; reads the live values instead of _last
+        char json[384];
+        serialize(capture(), nullptr, json, sizeof(json));
+        client->send(json, "state", millis());
+    });
+    server.addHandler(&_events);
+    xTaskCreatePinnedToCore(streamTask, "EventTask", 4096, this, 1, NULL, 0);
+}
+
+void EventStream::streamTask(void* param) {
+    EventStream* self = static_cast<EventStream*>(param);
+    for (;;) {
+        // Diagnostics first, so a finished WiFi scan is in /diagnostics before its delta goes out
+        diagnostics.update();
+        self->update();
+        vTaskDelay(pdMS_TO_TICKS(POLL_INTERVAL_MS));
+    }
+}
+
+void EventStream::update() {
+    LiveState state = capture();
+    if (memcmp(&state, &_last, sizeof(state)) == 0) {
+        return;
+    }
+    // Without listeners only the baseline moves; a new client starts from a full state
+    if (_events.count() > 0) {
+        char json[384];
+        if (serialize(state, &_last, json, sizeof(json)) > 0) {
+            _events.send(json, "delta", ++_eventId);
+            _eventsSent++;
+        }
+    }
+    _last = state;
+}
+
+LiveState EventStream::capture() {
+    // Zeroed first so padding bytes compare equal in update()
+    LiveState state;
+    memset(&state, 0, sizeof(state));
+    state.mailboxState = currentState;
+    state.closedSwitch = switchManager.isClosedPressed();
+    state.parcelSwitch = switchManager.isParcelPressed();
+    state.mailSwitch = switchManager.isMailPressed();
+    state.deliveryBlocked = deliveryBlocked;
+    state.oneTimeOpening = configManager.getConfig().oneTimeOpening;
+    state.wifiScanRunning = WiFi.scanComplete() == WIFI_SCAN_RUNNING;
+    state.calibrationActive = calibrationActive;
+    state.calibrationStep = calibrationStep;
+    state.calibrationCandidate = calibrationCandidateDuty;
+    state.scannedValue = lastScannedCredential.isValid() ? lastScannedCredential.value() : 0;
+    state.keypadValue = lastKeypadCredential.isValid() ? lastKeypadCredential.value() : 0;
+    state.keypadDigits = lastKeypadCredential.isValid() ? lastKeypadCredential.digits : 0;
+    state.scanCount = credentialScanCount;
+    return state;
+}
+
+// Writes the fields that differ from previous (all of them if previous is null)
+size_t EventStream::serialize(const LiveState& state, const LiveState* previous, char* out, size_t size) {
+    JsonDocument doc;
+    if (!previous || state.mailboxState != previous->mailboxState) {
+        doc["mailbox_state"] = mailboxStateName(state.mailboxState);
+    }
+    if (!previous || state.closedSwitch != previous->closedSwitch) {
+        doc["closed_switch"] = state.closedSwitch;
+    }
+    if (!previous || state.parcelSwitch != previous->parcelSwitch) {
+        doc["parcel_switch"] = state.parcelSwitch;
+    }
+    if (!previous || state.mailSwitch != previous->mailSwitch) {
+        doc["mail_switch"] = state.mailSwitch;
+    }
+    if (!previous || state.deliveryBlocked != previous->deliveryBlocked) {
+        doc["delivery_blocked"] = state.deliveryBlocked;
+    }
+    if (!previous || state.oneTimeOpening != previous->oneTimeOpening) {
+        doc["one_time_opening"] = state.oneTimeOpening;
+    }
+    if (!previous || state.wifiScanRunning != previous->wifiScanRunning) {
+        doc["wifi_scan_running"] = state.wifiScanRunning;
+    }
+    if (!previous || state.calibrationActive != previous->calibrationActive) {
+        doc["calibration_active"] = state.calibrationActive;
+    }
+    if (!previous || state.calibrationStep != previous->calibrationStep) {
+        doc["calibration_step"] = state.calibrationStep;
+    }
+    if (!previous || state.calibrationCandidate != previous->calibrationCandidate) {
+        doc["calibration_candidate"] = state.calibrationCandidate;
+    }
+    // A scan is reported even when the same card is presented again
+    if (!previous || state.scanCount != previous->scanCount || state.scannedValue != previous->scannedValue ||
+        state.keypadValue != previous->keypadValue || state.keypadDigits != previous->keypadDigits) {
+        char id[20] = "";
+        if (state.scannedValue != 0) {
+            snprintf(id, sizeof(id), "%llX", (unsigned long long)state.scannedValue);
+        }
+        doc["wiegand_id"] = id;
+        char code[20] = "";
+        if (state.keypadDigits != 0) {
+            snprintf(code, sizeof(code), "%0*llX", state.keypadDigits, (unsigned long long)state.keypadValue);
+        }
+        doc["last_code"] = code;
+        doc["scan_count"] = state.scanCount;
+    }
+    if (doc.size() == 0) {
+        return 0;
+    }
+    return serializeJson(doc, out, size);
+}
@@ -0,0 +1,41 @@
+#include "HeapMonitor.h"
+#include <esp_heap_caps.h>
+
+HeapMonitor heapMonitor;
+
+void HeapMonitor::begin() {
+    sample();
+}
+
+void HeapMonitor::update() {
+    if (millis() - _lastSample >= SAMPLE_INTERVAL_MS) {
+        sample();
+    }
+}
+
+uint32_t HeapMonitor::largestFreeBlock() const {
+    return heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+}
+
+void HeapMonitor::sample() {
+    uint32_t block = largestFreeBlock();
+    _samples[_next] = block;
+    _next = (_next + 1) % HISTORY_SIZE;
+    if (_count < HISTORY_SIZE) {
+        _count++;
+    }
+    if (block < _lowest) {
+        _lowest = block;
+    }
+    _sampleCount++;
+    _lastSample = millis();
+}
+
+uint8_t HeapMonitor::history(uint32_t* out, uint8_t maxSamples) const {
+    uint8_t n = _count < maxSamples ? _count : maxSamples;
+    uint8_t start = (_next + HISTORY_SIZE - _count) % HISTORY_SIZE;
+    for (uint8_t i = 0; i < n; i++) {
+        out[i] = _samples[(start + i) % HISTORY_SIZE];
+    }
+    return n;
+}
@@ -0,0 +1,38 @@
+#include "LittleFsStorage.h"
+#include <LittleFS.h>
+
+LittleFsStorage littleFsStorage;
+
+class LittleFsFile : public StorageFile {
+public:
+    explicit LittleFsFile(File file) : _file(file) {}
+    ~LittleFsFile() override { _file.close(); }
+
+    size_t read(void* data, size_t length) override { return _file.read(static_cast<uint8_t*>(data), length); }
+    size_t write(const void* data, size_t length) override { return _file.write(static_cast<const uint8_t*>(data), length); }
+    bool seek(size_t position) override { return _file.seek(position); }
+    size_t size() override { return _file.size(); }
+
+private:
+    File _file;
+};
+
+std::unique_ptr<StorageFile> LittleFsStorage::open(const char* path, const char* mode) {
+    File file = LittleFS.open(path, mode);
+    if (!file) {
+        return nullptr;
+    }
+    return std::unique_ptr<StorageFile>(new LittleFsFile(file));
+}
+
+bool LittleFsStorage::exists(const char* path) {
+    return LittleFS.exists(path);
+}
+
+bool LittleFsStorage::remove(const char* path) {
+    return LittleFS.remove(path);
+}
+
+bool LittleFsStorage::rename(const char* from, const char* to) {
+    return LittleFS.rename(from, to);
+}
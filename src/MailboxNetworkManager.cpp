@@ -1,72 +1,201 @@
 #include "MailboxNetworkManager.h"
 #include "ConfigManager.h"
+#include "CredentialStore.h"
+#include "CertStore.h"
+#include "WebhookDispatcher.h"
+#include "BootTimeline.h"
+#include "WifiSupervisor.h"
+#include "EventStream.h"
+#include "Diagnostics.h"
 #include "MelodyPlayer.h"
-#include "SwitchManager.h"
 #include "state.h"
 #include <WiFi.h>
 #include <FS.h>
 #include <LittleFS.h>
 #include <ArduinoJson.h>
 #include <Update.h>
-
-#ifndef FIRMWARE_VERSION
-#define FIRMWARE_VERSION "local-dev"
-#endif
+#include <memory>
 
 MailboxNetworkManager mailboxNetworkManager;
 
+static bool parseCredentialGroup(const String& name, CredentialGroup& group) {
+    if (name == "owner") {
+        group = CredentialGroup::OWNER;
+    } else if (name == "delivery") {
+        group = CredentialGroup::DELIVERY;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+static void addCertInfo(JsonObject out, CertId id) {
+    out["pem"] = *certStore.pem(id);
+    std::shared_ptr<const mbedtls_x509_crt> chain = certStore.chain(id);
+    uint8_t count = 0;
+    for (const mbedtls_x509_crt* crt = chain.get(); crt && crt->raw.len > 0; crt = crt->next) {
+        count++;
+    }
+    out["certificates"] = count;
+    if (chain) {
+        char validTo[20];
+        snprintf(validTo, sizeof(validTo), "%04d-%02d-%02d", chain->valid_to.year, chain->valid_to.mon, chain->valid_to.day);
+        out["valid_to"] = validTo;
+    }
+}
+
+// Streams one page of a credential group in index order. Every item is looked
+// up again from the key of the previous one, so edits between chunks are safe.
+struct CredentialPageStream {
+    CredentialGroup group;
+    size_t remaining;
+    CredentialRecord cursor;
+    bool inclusive = true;
+    bool first = true;
+    bool finished = false;
+    std::string pending;
+    size_t pendingPos = 0;
+
+    bool nextItem() {
+        if (finished) {
+            return false;
+        }
+        pending.clear();
+        std::shared_ptr<const CredentialIndex> snapshot = configManager.getCredentials();
+        const CredentialIndex& index = *snapshot;
+        const std::vector<CredentialRecord>& records = index.records();
+        size_t pos = remaining > 0 ? index.position(cursor, inclusive) : records.size();
+        while (pos < records.size() && records[pos].group != static_cast<uint8_t>(group)) {
+            pos++;
+        }
+        if (pos >= records.size()) {
+            pending = "]}";
+            finished = true;
+            return true;
+        }
+
+        const CredentialRecord& record = records[pos];
+        char code[CredentialStore::MAX_CODE_LENGTH + 1];
+        index.codeText(record, code, sizeof(code));
+        JsonDocument item;
+        item["code"] = code;
+        const char* label = index.label(record);
+        if (label) {
+            item["label"] = label;
+        }
+        if (!first) {
+            pending = ",";
+        }
+        std::string json;
+        serializeJson(item, json);
+        pending += json;
+
+        cursor = record;
+        inclusive = false;
+        first = false;
+        remaining--;
+        return true;
+    }
+
+    size_t fill(uint8_t* buffer, size_t maxLen) {
+        size_t written = 0;
+        while (written < maxLen) {
+            if (pendingPos >= pending.size()) {
+                if (!nextItem()) {
+                    break;
+                }
+                pendingPos = 0;
+            }
+            size_t n = std::min(maxLen - written, pending.size() - pendingPos);
+            memcpy(buffer + written, pending.data() + pendingPos, n);
+            written += n;
+            pendingPos += n;
+        }
+        return written;
+    }
+};
+
 MailboxNetworkManager::MailboxNetworkManager() :
     _server(80)
 {}
 
 void MailboxNetworkManager::begin() {
-    connectWiFi();
+    // Returns at once; the supervisor task joins the network in the background
+    wifiSupervisor.begin();
+    loadAssetManifest();
     setupWebServer();
+    diagnostics.begin();
+    eventStream.begin(_server);
     _server.begin();
+    bootTimeline.mark(BootPhase::WEB_SERVER_STARTED);
     Serial.println("Web server started.");
 }
 
-void MailboxNetworkManager::connectWiFi() {
-    Config& config = configManager.getConfig();
-    bool connected = false;
-    
-    if (config.ssid != "") {
-        Serial.print("Connecting to WiFi: ");
-        Serial.println(config.ssid);
-        WiFi.begin(config.ssid.c_str(), config.password.c_str());
-
-        unsigned long startTime = millis();
-        while (WiFi.status() != WL_CONNECTED) {
-            if (millis() - startTime > 30000) {
-                Serial.println("Failed to connect to WiFi within 30 seconds.");
-                break;
-            }
-            delay(500);
-            Serial.print(".");
-        }
-        if (WiFi.status() == WL_CONNECTED) {
-            Serial.println("Connected to WiFi");
-            Serial.print("IP address: ");
-            Serial.println(WiFi.localIP());
-            connected = true;
-        }
+void MailboxNetworkManager::loadAssetManifest() {
+    File file = LittleFS.open("/assets.txt", "r");
+    if (!file) {
+        Serial.println("No asset manifest, serving the web UI uncompressed.");
+        return;
+    }
+    String text = file.readString();
+    file.close();
+    Serial.printf("Asset manifest: %u files\n", (unsigned)_assets.parse(text.c_str()));
+}
+
+// Gzipped assets from the manifest with strong ETags; revalidation is answered
+// from RAM. Without a manifest (filesystem image built without gzip_assets.py)
+// the plain file is sent as before.
+void MailboxNetworkManager::serveAsset(AsyncWebServerRequest *request, const char* path) {
+    const Asset* asset = _assets.find(path);
+    if (!asset) {
+        request->send(LittleFS, path, "text/html");
+        return;
     }
 
-    if (!connected) {
-        Serial.println("Starting SoftAP for configuration.");
-        WiFi.softAP("Paketkasten-Setup", SOFTAP_PASSWORD);
-        Serial.print("SoftAP IP address: ");
-        Serial.println(WiFi.softAPIP());
+    // Both pages are navigated to under fixed URLs, so browsers always revalidate
+    const char* cacheControl = "no-cache";
+
+    if (request->hasHeader("If-None-Match") &&
+        AssetManifest::etagMatches(request->getHeader("If-None-Match")->value().c_str(), asset->etag)) {
+        _assetNotModified++;
+        AsyncWebServerResponse *response = request->beginResponse(304);
+        response->addHeader("ETag", asset->etag.c_str());
+        response->addHeader("Cache-Control", cacheControl);
+        request->send(response);
+        return;
+    }
+
+    String storedPath = path;
+    if (asset->gzipped) {
+        storedPath += ".gz";
+    }
+    auto file = std::make_shared<File>(LittleFS.open(storedPath, "r"));
+    if (!*file) {
+        request->send(404, "text/plain", "Not found");
+        return;
+    }
+    _assetResponses++;
+    // Every browser that renders the UI accepts gzip; there is no plain copy on flash
+    AsyncWebServerResponse *response = request->beginResponse(asset->contentType.c_str(), file->size(),
+        [file](uint8_t *buffer, size_t maxLen, size_t index) -> size_t {
+            return file->read(buffer, maxLen);
+        });
+    if (asset->gzipped) {
+        response->addHeader("Content-Encoding", "gzip");
     }
+    response->addHeader("ETag", asset->etag.c_str());
+    response->addHeader("Cache-Control", cacheControl);
+    response->addHeader("Vary", "Accept-Encoding");
+    request->send(response);
 }
 
 void MailboxNetworkManager::setupWebServer() {
-    _server.on("/", HTTP_GET, [](AsyncWebServerRequest *request){
-        request->send(LittleFS, "/index.html", "text/html");
+    _server.on("/", HTTP_GET, [this](AsyncWebServerRequest *request){
+        serveAsset(request, "/index.html");
     });
 
-    _server.on("/update", HTTP_GET, [](AsyncWebServerRequest *request){
-        request->send(LittleFS, "/update.html", "text/html");
+    _server.on("/update", HTTP_GET, [this](AsyncWebServerRequest *request){
+        serveAsset(request, "/update.html");
     });
 
     _server.on("/update", HTTP_POST, [](AsyncWebServerRequest *request){
@@ -85,6 +214,8 @@ void MailboxNetworkManager::setupWebServer() {
             }
             
             Serial.printf("Update Start: %s\n", filename.c_str());
+            // Pending settings must not depend on a write racing the flash update
+            configManager.flush();
             if(!Update.begin(UPDATE_SIZE_UNKNOWN, cmd)){
                 Update.printError(Serial);
             }
@@ -111,102 +242,100 @@ void MailboxNetworkManager::setupWebServer() {
         doc["mqttServer"] = config.mqttServer;
         doc["mqttPort"] = config.mqttPort;
         doc["mqttUser"] = config.mqttUser;
-        doc["ownerCodes"] = config.ownerCodes;
-        doc["deliveryCodes"] = config.deliveryCodes;
         doc["dutyCycleOpen"] = config.dutyCycleOpen;
         doc["dutyCycleClose"] = config.dutyCycleClose;
         doc["selectedMelody"] = config.selectedMelody;
         doc["callbackUrl"] = config.callbackUrl;
         doc["autolock"] = config.autolock;
-        doc["oneTimeCodes"] = config.oneTimeCodes;
+        doc["oneTimeCodes"] = configManager.getOneTimeCodesJson();
         doc["oneTimeOpening"] = config.oneTimeOpening;
         doc["mqttUseTls"] = config.mqttUseTls;
         doc["mqttSkipCertVal"] = config.mqttSkipCertVal;
+        doc["mqttEncoding"] = config.mqttEncoding == MQTT_ENCODING_MSGPACK ? "msgpack" : config.mqttEncoding == MQTT_ENCODING_BOTH ? "both" : "json";
         doc["callbackSkipCertVal"] = config.callbackSkipCertVal;
 
-        // Load MQTT CA Cert from LittleFS
-        String mqttCa = "";
-        if (LittleFS.exists("/certs/mqtt_ca.pem")) {
-            File file = LittleFS.open("/certs/mqtt_ca.pem", "r");
-            if (file) {
-                mqttCa = file.readString();
-                file.close();
-            }
-        }
-        doc["mqttCa"] = mqttCa;
-
-        // Load Callback CA Cert from LittleFS
-        String callbackCa = "";
-        if (LittleFS.exists("/certs/callback_ca.pem")) {
-            File file = LittleFS.open("/certs/callback_ca.pem", "r");
-            if (file) {
-                callbackCa = file.readString();
-                file.close();
-            }
-        }
-        doc["callbackCa"] = callbackCa;
-
         serializeJson(doc, jsonConfig);
         request->send(200, "application/json", jsonConfig);
     });
 
     _server.on("/save", HTTP_POST, [](AsyncWebServerRequest *request){
         Serial.println("Saving configuration...");
-        Config& config = configManager.getConfig();
-        config.ssid = request->arg("ssid");
+        Config config = configManager.getConfig();
+        bool fieldsFit = setConfigField(config.ssid, request->arg("ssid").c_str());
         if (request->hasArg("password") && request->arg("password") != "") {
-            config.password = request->arg("password");
+            fieldsFit &= setConfigField(config.password, request->arg("password").c_str());
         }
-        config.ownerCodes = request->arg("ownerCodes");
-        config.deliveryCodes = request->arg("deliveryCodes");
-        config.mqttServer = request->arg("mqttServer");
+        fieldsFit &= setConfigField(config.mqttServer, request->arg("mqttServer").c_str());
         config.mqttPort = request->arg("mqttPort").toInt();
-        config.mqttUser = request->arg("mqttUser");
+        fieldsFit &= setConfigField(config.mqttUser, request->arg("mqttUser").c_str());
         if (request->hasArg("mqttPassword") && request->arg("mqttPassword") != "") {
-            config.mqttPassword = request->arg("mqttPassword");
+            fieldsFit &= setConfigField(config.mqttPassword, request->arg("mqttPassword").c_str());
         }
         config.dutyCycleOpen = request->arg("dutyCycleOpen").toInt();
         config.dutyCycleClose = request->arg("dutyCycleClose").toInt();
-        config.selectedMelody = request->arg("selectedMelody");
-        config.callbackUrl = request->arg("callbackUrl");
+        fieldsFit &= setConfigField(config.selectedMelody, request->arg("selectedMelody").c_str());
+        fieldsFit &= setConfigField(config.callbackUrl, request->arg("callbackUrl").c_str());
+        if (!fieldsFit) {
+            request->send(400, "text/plain", "A setting exceeds its maximum length");
+            return;
+        }
         config.autolock = request->hasArg("autolock");
         config.oneTimeOpening = request->hasArg("oneTimeOpening");
         config.mqttUseTls = request->hasArg("mqttUseTls");
         config.mqttSkipCertVal = request->hasArg("mqttSkipCertVal");
+        if (request->hasArg("mqttEncoding")) {
+            String encoding = request->arg("mqttEncoding");
+            config.mqttEncoding = encoding == "msgpack" ? MQTT_ENCODING_MSGPACK : encoding == "both" ? MQTT_ENCODING_BOTH : MQTT_ENCODING_JSON;
+        }
         config.callbackSkipCertVal = request->hasArg("callbackSkipCertVal");
 
-        // Save MQTT CA Cert to LittleFS
-        if (request->hasArg("mqttCa")) {
-            if (!LittleFS.exists("/certs")) {
-                LittleFS.mkdir("/certs");
-            }
-            File file = LittleFS.open("/certs/mqtt_ca.pem", "w");
-            if (file) {
-                file.print(request->arg("mqttCa"));
-                file.close();
-                Serial.println("MQTT CA cert saved to LittleFS.");
-            }
+        uint32_t certChanges = 0;
+        if (request->hasArg("mqttCa") && certStore.save(CertId::MQTT_CA, request->arg("mqttCa"))) {
+            Serial.println("MQTT CA cert saved.");
+            certChanges |= CONFIG_MQTT;
+        }
+        if (request->hasArg("callbackCa") && certStore.save(CertId::CALLBACK_CA, request->arg("callbackCa"))) {
+            Serial.println("Callback CA cert saved.");
+            certChanges |= CONFIG_CALLBACK;
         }
 
-        // Save Callback CA Cert to LittleFS
-        if (request->hasArg("callbackCa")) {
-            if (!LittleFS.exists("/certs")) {
-                LittleFS.mkdir("/certs");
-            }
-            File file = LittleFS.open("/certs/callback_ca.pem", "w");
-            if (file) {
-                file.print(request->arg("callbackCa"));
-                file.close();
-                Serial.println("Callback CA cert saved to LittleFS.");
-            }
+        uint32_t changes = configManager.update(config);
+        if (certChanges & ~changes) {
+            configManager.notify(certChanges & ~changes);
         }
 
-        configManager.save();
-        delay(500);
-        Serial.println("Configuration saved. Restarting...");
+        Serial.println("Configuration saved and applied.");
+        request->send(200, "text/plain", "OK");
+    });
+
+    // CA certificates from the in-memory store, kept out of /config
+    _server.on("/api/certs", HTTP_GET, [](AsyncWebServerRequest *request){
+        JsonDocument doc;
+        addCertInfo(doc["mqttCa"].to<JsonObject>(), CertId::MQTT_CA);
+        addCertInfo(doc["callbackCa"].to<JsonObject>(), CertId::CALLBACK_CA);
+        String json;
+        serializeJson(doc, json);
+        request->send(200, "application/json", json);
+    });
+
+    // Webhook sinks and their delivery counters
+    _server.on("/api/webhooks", HTTP_GET, [](AsyncWebServerRequest *request){
+        request->send(200, "application/json", webhookDispatcher.statusJson());
+    });
+
+    // Replaces the sink list: sinks=[{"name","url","body","events","batch_ms","insecure"}].
+    // url and body are templates; without a body the batch is POSTed as JSON, "" sends a GET.
+    _server.on("/api/webhooks", HTTP_POST, [](AsyncWebServerRequest *request){
+        if (!request->hasArg("sinks")) {
+            request->send(400, "text/plain", "Missing sinks");
+            return;
+        }
+        const char* error = webhookDispatcher.saveSinks(request->arg("sinks").c_str());
+        if (error) {
+            request->send(400, "text/plain", error);
+            return;
+        }
         request->send(200, "text/plain", "OK");
-        delay(2000);
-        shouldRestart = true;
     });
 
     _server.on("/factoryreset", HTTP_POST, [](AsyncWebServerRequest *request){
@@ -217,49 +346,29 @@ void MailboxNetworkManager::setupWebServer() {
         shouldRestart = true;
     });
 
+    // Served from the snapshot kept by Diagnostics; unchanged generations get a 304
     _server.on("/diagnostics", HTTP_GET, [](AsyncWebServerRequest *request){
-        int16_t status = WiFi.scanComplete();
-        bool scanRunning = (status == WIFI_SCAN_RUNNING);
-        static String cachedWifiJson = "[]";
-
-        if (status >= 0) {
-            JsonDocument wifiDoc;
-            JsonArray networks = wifiDoc.to<JsonArray>();
-            for (int i = 0; i < status; ++i) {
-                JsonObject net = networks.add<JsonObject>();
-                net["ssid"] = WiFi.SSID(i);
-                net["rssi"] = WiFi.RSSI(i);
-                net["secure"] = WiFi.encryptionType(i) != WIFI_AUTH_OPEN;
-            }
-            cachedWifiJson = "";
-            serializeJson(wifiDoc, cachedWifiJson);
-            WiFi.scanDelete();
-        }
-
-        String jsonResponse;
-        JsonDocument doc;
-        doc["wiegand_id"] = lastScannedWiegandId;
-        doc["last_code"] = lastKeypadCode;
-        doc["firmware_version"] = FIRMWARE_VERSION;
-        doc["mailbox_state"] = getMailboxStateString();
-        doc["closed_switch"] = switchManager.isClosedPressed();
-        doc["parcel_switch"] = switchManager.isParcelPressed();
-        doc["mail_switch"] = switchManager.isMailPressed();
-        doc["delivery_blocked"] = deliveryBlocked;
-        doc["one_time_opening"] = configManager.getConfig().oneTimeOpening;
-        doc["wifi_scan_running"] = scanRunning;
-        doc["calibration_active"] = calibrationActive;
-        doc["calibration_step"] = (int)calibrationStep;
-        doc["calibration_candidate"] = (int)calibrationCandidateDuty;
-
-        if (cachedWifiJson != "") {
-            doc["wifi_networks"] = serialized(cachedWifiJson);
-        } else {
-            doc["wifi_networks"] = serialized("[]");
+        char etag[24];
+        diagnostics.etag(etag, sizeof(etag));
+        if (request->hasHeader("If-None-Match") &&
+            AssetManifest::etagMatches(request->getHeader("If-None-Match")->value().c_str(), etag)) {
+            AsyncWebServerResponse *response = request->beginResponse(304);
+            response->addHeader("ETag", etag);
+            response->addHeader("Cache-Control", "no-cache");
+            request->send(response);
+            return;
         }
 
-        serializeJson(doc, jsonResponse);
-        request->send(200, "application/json", jsonResponse);
+        std::shared_ptr<const std::string> body = diagnostics.snapshot(etag, sizeof(etag));
+        AsyncWebServerResponse *response = request->beginResponse("application/json", body->size(),
+            [body](uint8_t *buffer, size_t maxLen, size_t index) -> size_t {
+                size_t n = std::min(maxLen, body->size() - index);
+                memcpy(buffer, body->data() + index, n);
+                return n;
+            });
+        response->addHeader("ETag", etag);
+        response->addHeader("Cache-Control", "no-cache");
+        request->send(response);
     });
 
     _server.on("/scan", HTTP_GET, [](AsyncWebServerRequest *request){
@@ -275,11 +384,101 @@ void MailboxNetworkManager::setupWebServer() {
         }
     });
 
+    // Paginated listing: ?group=owner|delivery&offset=0&limit=50
+    _server.on("/api/credentials", HTTP_GET, [](AsyncWebServerRequest *request){
+        CredentialGroup group = CredentialGroup::OWNER;
+        if (request->hasParam("group") && !parseCredentialGroup(request->getParam("group")->value(), group)) {
+            request->send(400, "text/plain", "Unknown group");
+            return;
+        }
+        size_t offset = request->hasParam("offset") ? request->getParam("offset")->value().toInt() : 0;
+        size_t limit = request->hasParam("limit") ? request->getParam("limit")->value().toInt() : 50;
+        if (limit == 0 || limit > 200) {
+            limit = 200;
+        }
+
+        std::shared_ptr<const CredentialIndex> snapshot = configManager.getCredentials();
+        const CredentialIndex& index = *snapshot;
+        size_t total = index.count(group);
+        auto stream = std::make_shared<CredentialPageStream>();
+        stream->group = group;
+        stream->remaining = 0;
+        size_t skipped = 0;
+        for (const CredentialRecord& record : index.records()) {
+            if (record.group != static_cast<uint8_t>(group)) {
+                continue;
+            }
+            if (skipped++ == offset) {
+                stream->cursor = record;
+                stream->remaining = limit;
+                break;
+            }
+        }
+
+        char header[112];
+        snprintf(header, sizeof(header), "{\"group\":\"%s\",\"offset\":%u,\"limit\":%u,\"total\":%u,\"items\":[",
+                 group == CredentialGroup::OWNER ? "owner" : "delivery", (unsigned)offset, (unsigned)limit, (unsigned)total);
+        stream->pending = header;
+        request->send(request->beginChunkedResponse("application/json", [stream](uint8_t *buffer, size_t maxLen, size_t index) -> size_t {
+            return stream->fill(buffer, maxLen);
+        }));
+    });
+
+    // Adds a code or changes its label: group, code, label
+    _server.on("/api/credentials", HTTP_POST, [](AsyncWebServerRequest *request){
+        CredentialGroup group;
+        if (!request->hasArg("group") || !parseCredentialGroup(request->arg("group"), group)) {
+            request->send(400, "text/plain", "Unknown group");
+            return;
+        }
+        String code = request->arg("code");
+        String label = request->arg("label");
+        code.trim();
+        if (code.length() == 0 || code.length() > CredentialStore::MAX_CODE_LENGTH || label.length() > CredentialStore::MAX_LABEL_LENGTH) {
+            request->send(400, "text/plain", "Invalid code or label");
+            return;
+        }
+        if (configManager.addCredential(group, code.c_str(), label.c_str()) != CredentialUpdate::APPLIED) {
+            request->send(500, "text/plain", "Could not store credential");
+            return;
+        }
+        Serial.printf("Credential added via API: %s\n", label.c_str());
+        request->send(200, "text/plain", "OK");
+    });
+
+    // Removes a code: ?group=owner|delivery&code=...
+    _server.on("/api/credentials", HTTP_DELETE, [](AsyncWebServerRequest *request){
+        CredentialGroup group;
+        if (!request->hasArg("group") || !parseCredentialGroup(request->arg("group"), group) || !request->hasArg("code")) {
+            request->send(400, "text/plain", "Bad Request");
+            return;
+        }
+        String code = request->arg("code");
+        code.trim();
+        if (code.length() == 0 || code.length() > CredentialStore::MAX_CODE_LENGTH) {
+            request->send(400, "text/plain", "Invalid code");
+            return;
+        }
+        switch (configManager.removeCredential(group, code.c_str())) {
+            case CredentialUpdate::APPLIED:
+                Serial.println("Credential removed via API");
+                request->send(200, "text/plain", "OK");
+                break;
+            case CredentialUpdate::NOT_FOUND:
+                request->send(404, "text/plain", "Not Found");
+                break;
+            default:
+                request->send(500, "text/plain", "Could not store credential");
+                break;
+        }
+    });
+
     _server.on("/save-onetime-codes", HTTP_POST, [](AsyncWebServerRequest *request){
         if (request->hasParam("oneTimeCodes", true)) {
-            Config& config = configManager.getConfig();
-            config.oneTimeCodes = request->getParam("oneTimeCodes", true)->value();
-            configManager.save();
+            if (!configManager.setOneTimeCodes(request->getParam("oneTimeCodes", true)->value().c_str())) {
+                request->send(400, "text/plain", "Invalid one-time codes");
+                return;
+            }
             Serial.println("One-time codes saved dynamically.");
             request->send(200, "text/plain", "OK");
         } else {
@@ -292,7 +491,7 @@ void MailboxNetworkManager::setupWebServer() {
             String melodyType = request->getParam("melody", true)->value();
             Serial.print("Playing melody: ");
             Serial.println(melodyType);
-            melodyPlayer.play(melodyType);
+            melodyPlayer.play(melodyType.c_str());
             request->send(200, "text/plain", "OK");
         } else {
             request->send(400, "text/plain", "Bad Request");
@@ -20,7 +20,7 @@ void MelodyPlayer::begin() {
     pinMode(_buzzerPin, OUTPUT);
 }
 
-void MelodyPlayer::play(const String& melodyName) {
+void MelodyPlayer::play(const char* melodyName) {
     _currentMelody = nullptr;
     _currentTempo = nullptr;
     _melodySize = 0;
@@ -30,11 +30,11 @@ void MelodyPlayer::play(const String& melodyName) {
     _melodyPlaying = false;
     noTone(_buzzerPin);
 
-    if (melodyName == "NONE") {
+    if (strcmp(melodyName, "NONE") == 0) {
         return;
     }
 
-    if (melodyName == "NOKIA_TUNE") {
+    if (strcmp(melodyName, "NOKIA_TUNE") == 0) {
         _wholenote = 1333;
         static int nokiaTuneMelody[] = {
             NOTE_E5, NOTE_D5, NOTE_FS4, NOTE_GS4, NOTE_CS5, NOTE_B4, NOTE_D4, NOTE_E4, NOTE_B4, NOTE_A4, NOTE_CS4, NOTE_E4, NOTE_A4
@@ -45,7 +45,7 @@ void MelodyPlayer::play(const String& melodyName) {
         _currentMelody = nokiaTuneMelody;
         _currentTempo = nokiaTuneTempo;
         _melodySize = sizeof(nokiaTuneMelody) / sizeof(int);
-    } else if (melodyName == "IMPERIAL_MARCH") {
+    } else if (strcmp(melodyName, "IMPERIAL_MARCH") == 0) {
         _wholenote = 1800;
         static int imperialMarchMelody[] = {
             NOTE_A4, NOTE_A4, NOTE_A4, NOTE_F4, NOTE_C5,
@@ -62,7 +62,7 @@ void MelodyPlayer::play(const String& melodyName) {
         _currentMelody = imperialMarchMelody;
         _currentTempo = imperialMarchTempo;
         _melodySize = sizeof(imperialMarchMelody) / sizeof(int);
-    } else if (melodyName == "MARIO") {
+    } else if (strcmp(melodyName, "MARIO") == 0) {
         _wholenote = 1000;
         static int marioMelody[] = {
             NOTE_E5, NOTE_E5, REST, NOTE_E5, REST, NOTE_C5, NOTE_E5, REST,
@@ -83,7 +83,7 @@ void MelodyPlayer::play(const String& melodyName) {
         _currentMelody = marioMelody;
         _currentTempo = marioTempo;
         _melodySize = sizeof(marioMelody) / sizeof(int);
-    } else if (melodyName == "WINDOWS_XP_STARTUP") {
+    } else if (strcmp(melodyName, "WINDOWS_XP_STARTUP") == 0) {
         _wholenote = 1000;
         static int windowsXpStartupMelody[] = {
             NOTE_DS5, NOTE_GS4, NOTE_AS4, NOTE_DS5, NOTE_GS4, NOTE_AS4, NOTE_DS5
@@ -94,7 +94,7 @@ void MelodyPlayer::play(const String& melodyName) {
         _currentMelody = windowsXpStartupMelody;
         _currentTempo = windowsXpStartupTempo;
         _melodySize = sizeof(windowsXpStartupMelody) / sizeof(int);
-    } else if (melodyName == "INTEL_INSIDE") {
+    } else if (strcmp(melodyName, "INTEL_INSIDE") == 0) {
         _wholenote = 400;
         static int intelInsideMelody[] = {
             NOTE_DS4, NOTE_DS4, NOTE_GS4, NOTE_DS4, NOTE_AS4
@@ -105,7 +105,7 @@ void MelodyPlayer::play(const String& melodyName) {
         _currentMelody = intelInsideMelody;
         _currentTempo = intelInsideTempo;
         _melodySize = sizeof(intelInsideMelody) / sizeof(int);
-    } else if (melodyName == "TETRIS") {
+    } else if (strcmp(melodyName, "TETRIS") == 0) {
         _wholenote = 1000;
         static int tetrisMelody[] = {
             NOTE_E5, NOTE_B4, NOTE_C5, NOTE_D5, NOTE_E5, NOTE_D5, NOTE_C5, NOTE_B4,
@@ -126,7 +126,7 @@ void MelodyPlayer::play(const String& melodyName) {
         _currentMelody = tetrisMelody;
         _currentTempo = tetrisTempo;
         _melodySize = sizeof(tetrisMelody) / sizeof(int);
-    } else if (melodyName == "GEMINI") {
+    } else if (strcmp(melodyName, "GEMINI") == 0) {
         _wholenote = 1200;
         static int geminiMelody[] = {
             NOTE_A5, NOTE_B5, NOTE_CS6, NOTE_E6, NOTE_D6, NOTE_E6, NOTE_FS6, NOTE_A6
@@ -0,0 +1,462 @@
+#include "MqttCommand.h"
+#include <cstring>
+
+bool PayloadView::equals(const char* text) const {
+    return strlen(text) == length && memcmp(data, text, length) == 0;
+}
+
+bool PayloadView::copyTo(char* out, size_t size) const {
+    if (length >= size) {
+        return false;
+    }
+    if (length > 0) {
+        memcpy(out, data, length);
+    }
+    out[length] = '\0';
+    return true;
+}
+
+struct Cursor {
+    char* p;
+    char* end;
+};
+
+static bool isJsonSpace(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+static void skipSpace(Cursor& c) {
+    while (c.p < c.end && isJsonSpace(*c.p)) {
+        c.p++;
+    }
+}
+
+static int hexValue(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+// Reads the string after the opening quote, decoding escapes in place. The
+// decoded text is never longer than its escaped form, so it fits.
+static bool readJsonString(Cursor& c, PayloadView& out) {
+    char* write = c.p;
+    out.data = write;
+    while (c.p < c.end) {
+        char ch = *c.p++;
+        if (ch == '"') {
+            out.length = write - out.data;
+            return true;
+        }
+        if (static_cast<unsigned char>(ch) < 0x20) {
+            return false;
+        }
+        if (ch != '\\') {
+            *write++ = ch;
+            continue;
+        }
+        if (c.p >= c.end) {
+            return false;
+        }
+        char escaped = *c.p++;
+        switch (escaped) {
+            case '"': case '\\': case '/': *write++ = escaped; break;
+            case 'b': *write++ = '\b'; break;
+            case 'f': *write++ = '\f'; break;
+            case 'n': *write++ = '\n'; break;
+            case 'r': *write++ = '\r'; break;
+            case 't': *write++ = '\t'; break;
+            case 'u': {
+                if (c.end - c.p < 4) {
+                    return false;
+                }
+                uint32_t cp = 0;
+                for (int i = 0; i < 4; ++i) {
+                    int digit = hexValue(*c.p++);
+                    if (digit < 0) {
+                        return false;
+                    }
+                    cp = (cp << 4) | digit;
+                }
+                // Surrogate pairs never occur in codes, labels or ids
+                if (cp >= 0xD800 && cp <= 0xDFFF) {
+                    return false;
+                }
+                if (cp < 0x80) {
+                    *write++ = static_cast<char>(cp);
+                } else if (cp < 0x800) {
+                    *write++ = static_cast<char>(0xC0 | (cp >> 6));
+                    *write++ = static_cast<char>(0x80 | (cp & 0x3F));
+                } else {
+                    *write++ = static_cast<char>(0xE0 | (cp >> 12));
+                    *write++ = static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+                    *write++ = static_cast<char>(0x80 | (cp & 0x3F));
+                }
+                break;
+            }
+            default:
+                return false;
+        }
+    }
+    return false;
+}
+
+// Numbers, true, false and null are accepted and ignored
+static bool skipJsonScalar(Cursor& c) {
+    char* start = c.p;
+    while (c.p < c.end && *c.p != ',' && *c.p != '}' && !isJsonSpace(*c.p)) {
+        char ch = *c.p;
+        if (!((ch >= '0' && ch <= '9') || (ch >= 'a' && ch <= 'z') || ch == '-' || ch == '+' || ch == '.' || ch == 'E')) {
+            return false;
+        }
+        c.p++;
+    }
+    return c.p > start;
+}
+
+static void assignField(MqttCommand& out, PayloadView& name, const PayloadView& key, const PayloadView& value) {
+    if (key.equals("cmd") || key.equals("command")) {
+        name = value;
+    } else if (key.equals("id")) {
+        out.id = value;
+    } else if (key.equals("compartment")) {
+        out.compartment = value;
+    } else if (key.equals("melody")) {
+        out.melody = value;
+    } else if (key.equals("group")) {
+        out.group = value;
+    } else if (key.equals("code")) {
+        out.code = value;
+    } else if (key.equals("label")) {
+        out.label = value;
+    }
+}
+
+static const char* parseJson(Cursor& c, MqttCommand& out, PayloadView& name) {
+    skipSpace(c);
+    if (c.p >= c.end || *c.p++ != '{') {
+        return "malformed JSON";
+    }
+    skipSpace(c);
+    if (c.p < c.end && *c.p == '}') {
+        c.p++;
+    } else {
+        for (;;) {
+            PayloadView key;
+            PayloadView value;
+            if (c.p >= c.end || *c.p++ != '"' || !readJsonString(c, key)) {
+                return "malformed JSON";
+            }
+            skipSpace(c);
+            if (c.p >= c.end || *c.p++ != ':') {
+                return "malformed JSON";
+            }
+            skipSpace(c);
+            if (c.p >= c.end) {
+                return "malformed JSON";
+            }
+            if (*c.p == '"') {
+                c.p++;
+                if (!readJsonString(c, value)) {
+                    return "malformed JSON";
+                }
+                assignField(out, name, key, value);
+            } else if (*c.p == '{' || *c.p == '[') {
+                return "nested values are not supported";
+            } else if (!skipJsonScalar(c)) {
+                return "malformed JSON";
+            }
+            skipSpace(c);
+            if (c.p < c.end && *c.p == ',') {
+                c.p++;
+                skipSpace(c);
+                continue;
+            }
+            if (c.p < c.end && *c.p == '}') {
+                c.p++;
+                break;
+            }
+            return "malformed JSON";
+        }
+    }
+    skipSpace(c);
+    return c.p == c.end ? nullptr : "malformed JSON";
+}
+
+static bool readBigEndian(Cursor& c, size_t bytes, uint32_t& value) {
+    if (static_cast<size_t>(c.end - c.p) < bytes) {
+        return false;
+    }
+    value = 0;
+    for (size_t i = 0; i < bytes; ++i) {
+        value = (value << 8) | static_cast<uint8_t>(*c.p++);
+    }
+    return true;
+}
+
+// fixstr, str8 and str16; false for anything else
+static bool readMsgpackString(Cursor& c, PayloadView& out) {
+    if (c.p >= c.end) {
+        return false;
+    }
+    uint8_t tag = static_cast<uint8_t>(*c.p++);
+    uint32_t length;
+    if ((tag & 0xE0) == 0xA0) {
+        length = tag & 0x1F;
+    } else if (tag == 0xD9) {
+        if (!readBigEndian(c, 1, length)) return false;
+    } else if (tag == 0xDA) {
+        if (!readBigEndian(c, 2, length)) return false;
+    } else {
+        return false;
+    }
+    if (static_cast<size_t>(c.end - c.p) < length) {
+        return false;
+    }
+    out.data = c.p;
+    out.length = length;
+    c.p += length;
+    return true;
+}
+
+// nil, booleans, integers and floats are accepted and ignored
+static bool skipMsgpackScalar(Cursor& c) {
+    uint8_t tag = static_cast<uint8_t>(*c.p++);
+    size_t skip;
+    if (tag <= 0x7F || tag >= 0xE0 || tag == 0xC0 || tag == 0xC2 || tag == 0xC3) {
+        skip = 0;
+    } else if (tag == 0xCC || tag == 0xD0) {
+        skip = 1;
+    } else if (tag == 0xCD || tag == 0xD1) {
+        skip = 2;
+    } else if (tag == 0xCE || tag == 0xD2 || tag == 0xCA) {
+        skip = 4;
+    } else if (tag == 0xCF || tag == 0xD3 || tag == 0xCB) {
+        skip = 8;
+    } else {
+        return false;
+    }
+    if (static_cast<size_t>(c.end - c.p) < skip) {
+        return false;
+    }
+    c.p += skip;
+    return true;
+}
+
+static const char* parseMsgpack(Cursor& c, MqttCommand& out, PayloadView& name) {
+    uint8_t tag = static_cast<uint8_t>(*c.p++);
+    uint32_t count;
+    if ((tag & 0xF0) == 0x80) {
+        count = tag & 0x0F;
+    } else if (!readBigEndian(c, 2, count)) {
+        return "malformed MessagePack";
+    }
+    for (uint32_t i = 0; i < count; ++i) {
+        PayloadView key;
+        PayloadView value;
+        if (!readMsgpackString(c, key) || c.p >= c.end) {
+            return "malformed MessagePack";
+        }
+        uint8_t valueTag = static_cast<uint8_t>(*c.p);
+        if ((valueTag & 0xE0) == 0xA0 || valueTag == 0xD9 || valueTag == 0xDA) {
+            if (!readMsgpackString(c, value)) {
+                return "malformed MessagePack";
+            }
+            assignField(out, name, key, value);
+        } else if (!skipMsgpackScalar(c)) {
+            return "unsupported MessagePack value";
+        }
+    }
+    return c.p == c.end ? nullptr : "malformed MessagePack";
+}
+
+static const char* parseText(Cursor& c, MqttCommand& out) {
+    skipSpace(c);
+    while (c.end > c.p && isJsonSpace(c.end[-1])) {
+        c.end--;
+    }
+    PayloadView word;
+    word.data = c.p;
+    word.length = c.end - c.p;
+    if (word.equals("OPEN_PARCEL")) {
+        out.compartment.data = "parcel";
+    } else if (word.equals("OPEN_MAIL")) {
+        out.compartment.data = "mail";
+    } else {
+        return "unknown command";
+    }
+    out.compartment.length = strlen(out.compartment.data);
+    out.action = MqttCommandAction::OPEN;
+    return nullptr;
+}
+
+static const MqttCommandAction ACTIONS[] = {
+    MqttCommandAction::OPEN, MqttCommandAction::CALIBRATE, MqttCommandAction::PLAY_MELODY,
+    MqttCommandAction::ADD_CODE, MqttCommandAction::REVOKE_CODE, MqttCommandAction::GET_STATE
+};
+
+const char* mqttCommandName(MqttCommandAction action) {
+    switch (action) {
+        case MqttCommandAction::OPEN: return "open";
+        case MqttCommandAction::CALIBRATE: return "calibrate";
+        case MqttCommandAction::PLAY_MELODY: return "play_melody";
+        case MqttCommandAction::ADD_CODE: return "add_code";
+        case MqttCommandAction::REVOKE_CODE: return "revoke_code";
+        case MqttCommandAction::GET_STATE: return "get_state";
+        default: return "unknown";
+    }
+}
+
+static const char* validate(MqttCommand& out, const PayloadView& name) {
+    for (MqttCommandAction action : ACTIONS) {
+        if (name.equals(mqttCommandName(action))) {
+            out.action = action;
+        }
+    }
+    switch (out.action) {
+        case MqttCommandAction::NONE:
+            return name.empty() ? "missing cmd" : "unknown command";
+        case MqttCommandAction::OPEN:
+            return out.compartment.equals("parcel") || out.compartment.equals("mail") ? nullptr : "compartment must be parcel or mail";
+        case MqttCommandAction::PLAY_MELODY:
+            return out.melody.empty() ? "missing melody" : nullptr;
+        case MqttCommandAction::ADD_CODE:
+        case MqttCommandAction::REVOKE_CODE:
+            if (!out.group.equals("owner") && !out.group.equals("delivery")) {
+                return "group must be owner or delivery";
+            }
+            return out.code.empty() ? "missing code" : nullptr;
+        default:
+            return nullptr;
+    }
+}
+
+const char* parseMqttCommand(char* payload, size_t length, MqttCommand& out) {
+    out = MqttCommand();
+    if (length == 0) {
+        return "empty command";
+    }
+    Cursor c = { payload, payload + length };
+    Cursor probe = c;
+    skipSpace(probe);
+    uint8_t first = static_cast<uint8_t>(*payload);
+    PayloadView name;
+    const char* error;
+    if (probe.p < probe.end && *probe.p == '{') {
+        out.format = PayloadFormat::JSON;
+        error = parseJson(c, out, name);
+    } else if ((first & 0xF0) == 0x80 || first == 0xDE) {
+        out.format = PayloadFormat::MSGPACK;
+        error = parseMsgpack(c, out, name);
+    } else {
+        return parseText(c, out);
+    }
+    if (out.id.length > MQTT_COMMAND_MAX_ID) {
+        out.id.length = 0;
+        return "id too long";
+    }
+    return error ? error : validate(out, name);
+}
+
+// Bounded output buffer; overflow is reported once at the end
+struct ResponseWriter {
+    char* out;
+    size_t size;
+    size_t pos;
+    bool overflow;
+
+    ResponseWriter(char* buffer, size_t capacity) : out(buffer), size(capacity), pos(0), overflow(false) {}
+
+    void put(char c) {
+        if (pos < size) {
+            out[pos++] = c;
+        } else {
+            overflow = true;
+        }
+    }
+    void put(const char* data, size_t length) {
+        for (size_t i = 0; i < length; ++i) {
+            put(data[i]);
+        }
+    }
+    void put(const char* text) { put(text, strlen(text)); }
+
+    void jsonString(const char* data, size_t length) {
+        static const char* const HEX_DIGITS = "0123456789abcdef";
+        put('"');
+        for (size_t i = 0; i < length; ++i) {
+            unsigned char c = static_cast<unsigned char>(data[i]);
+            if (c == '"' || c == '\\') {
+                put('\\');
+                put(static_cast<char>(c));
+            } else if (c < 0x20) {
+                put("\\u00");
+                put(HEX_DIGITS[c >> 4]);
+                put(HEX_DIGITS[c & 0x0F]);
+            } else {
+                put(static_cast<char>(c));
+            }
+        }
+        put('"');
+    }
+
+    void msgpackString(const char* data, size_t length) {
+        if (length < 32) {
+            put(static_cast<char>(0xA0 | length));
+        } else if (length < 256) {
+            put(static_cast<char>(0xD9));
+            put(static_cast<char>(length));
+        } else {
+            put(static_cast<char>(0xDA));
+            put(static_cast<char>(length >> 8));
+            put(static_cast<char>(length & 0xFF));
+        }
+        put(data, length);
+    }
+};
+
+size_t formatMqttResponse(char* out, size_t size, const MqttCommand& command, const char* error, const char* state) {
+    ResponseWriter w(out, size);
+    const char* name = mqttCommandName(command.action);
+    if (command.format == PayloadFormat::MSGPACK) {
+        uint8_t fields = 2 + (command.id.empty() ? 0 : 1) + (error ? 1 : 0) + (state ? 1 : 0);
+        w.put(static_cast<char>(0x80 | fields));
+        if (!command.id.empty()) {
+            w.msgpackString("id", 2);
+            w.msgpackString(command.id.data, command.id.length);
+        }
+        w.msgpackString("cmd", 3);
+        w.msgpackString(name, strlen(name));
+        w.msgpackString("ok", 2);
+        w.put(static_cast<char>(error ? 0xC2 : 0xC3));
+        if (error) {
+            w.msgpackString("error", 5);
+            w.msgpackString(error, strlen(error));
+        }
+        if (state) {
+            w.msgpackString("state", 5);
+            w.msgpackString(state, strlen(state));
+        }
+    } else {
+        w.put('{');
+        if (!command.id.empty()) {
+            w.put("\"id\":");
+            w.jsonString(command.id.data, command.id.length);
+            w.put(',');
+        }
+        w.put("\"cmd\":");
+        w.jsonString(name, strlen(name));
+        w.put(error ? ",\"ok\":false" : ",\"ok\":true");
+        if (error) {
+            w.put(",\"error\":");
+            w.jsonString(error, strlen(error));
+        }
+        if (state) {
+            w.put(",\"state\":");
+            w.jsonString(state, strlen(state));
+        }
+        w.put('}');
+    }
+    return w.overflow ? 0 : w.pos;
+}
@@ -1,7 +1,9 @@
 #include "MqttManager.h"
 #include "ConfigManager.h"
 #include "state.h"
-#include <LittleFS.h>
+#include "BootTimeline.h"
+#include "CertStore.h"
+#include <ArduinoJson.h>
 
 MqttManager mqttManager;
 
@@ -16,34 +18,47 @@ MqttManager::~MqttManager() {
 }
 
 void MqttManager::begin(void (*callback)(char* topic, byte* payload, unsigned int length)) {
+    _callback = callback;
+    _journal.begin();
+    setupClient();
+    // Below everything else on core 0: a slow handshake only uses idle time
+    xTaskCreatePinnedToCore(connectTask, "MqttConnect", 8192, this, tskIDLE_PRIORITY, &_connectTask, 0);
+}
+
+void MqttManager::connectTask(void* param) {
+    MqttManager* self = static_cast<MqttManager*>(param);
+    for (;;) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        // mqttTask leaves the client alone until _transportDone is set
+        Config& config = configManager.getConfig();
+        self->_transportOk = self->_netClient->connect(config.mqttServer, config.mqttPort) != 0;
+        self->_transportDone = true;
+    }
+}
+
+void MqttManager::setupClient() {
     Config& config = configManager.getConfig();
-    if (config.mqttServer != "") {
+    if (_netClient != nullptr) {
+        delete _netClient;
+        _netClient = nullptr;
+    }
+    if (config.mqttServer[0] != '\0') {
         Serial.print("Setting up MQTT server: ");
         Serial.println(config.mqttServer);
 
-        if (_netClient != nullptr) {
-            delete _netClient;
-            _netClient = nullptr;
-        }
-
         if (config.mqttUseTls) {
             Serial.println("MQTT: Using TLS (Secure connection)");
             WiFiClientSecure* secureClient = new WiFiClientSecure();
+            secureClient->setHandshakeTimeout(HANDSHAKE_TIMEOUT_S);
             if (config.mqttSkipCertVal) {
                 Serial.println("MQTT: Skipping certificate validation (Insecure)");
                 secureClient->setInsecure();
             } else {
-                String caCert = "";
-                if (LittleFS.exists("/certs/mqtt_ca.pem")) {
-                    File file = LittleFS.open("/certs/mqtt_ca.pem", "r");
-                    if (file) {
-                        caCert = file.readString();
-                        file.close();
-                    }
-                }
-                if (caCert.length() > 0) {
+                // The client keeps a pointer to the PEM, so hold on to it
+                _caCert = certStore.pem(CertId::MQTT_CA);
+                if (!_caCert->empty()) {
                     Serial.println("MQTT: Setting Root CA certificate");
-                    secureClient->setCACert(caCert.c_str());
+                    secureClient->setCACert(_caCert->c_str());
                 } else {
                     Serial.println("MQTT Warning: TLS requested but no CA certificate found. Falling back to insecure mode.");
                     secureClient->setInsecure();
@@ -56,9 +71,11 @@ void MqttManager::begin(void (*callback)(char* topic, byte* payload, unsigned in
         }
 
         _mqttClient.setClient(*_netClient);
-        _mqttClient.setServer(config.mqttServer.c_str(), config.mqttPort);
-        _mqttClient.setCallback(callback);
+        _mqttClient.setServer(config.mqttServer, config.mqttPort);
+        _mqttClient.setCallback(_callback);
+        _mqttClient.setSocketTimeout(SOCKET_TIMEOUT_S);
     }
+    _session.reset(_netClient != nullptr, millis());
 }
 
 bool MqttManager::isConnected() {
@@ -69,50 +86,102 @@ void MqttManager::publish(const char* topic, const char* payload) {
     _mqttClient.publish(topic, payload);
 }
 
-void MqttManager::reconnect() {
+bool MqttManager::networkUp() {
+    // Without a station link a connect attempt would only fail in DNS
+    return WiFi.status() == WL_CONNECTED;
+}
+
+void MqttManager::beginConnect() {
+    _transportDone = false;
+    xTaskNotifyGive(_connectTask);
+}
+
+int MqttManager::connectResult() {
+    if (!_transportDone) {
+        return 0;
+    }
+    if (!_transportOk) {
+        Serial.println("MQTT: broker unreachable or TLS handshake failed");
+        return -1;
+    }
+    return 1;
+}
+
+bool MqttManager::handshake() {
     Config& config = configManager.getConfig();
-    long now = millis();
-    static long lastReconnectAttempt = 0;
-    if (now - lastReconnectAttempt > 5000) {
-        lastReconnectAttempt = now;
-        Serial.println("Attempting MQTT connection...");
-        if (_mqttClient.connect("Paketkasten", config.mqttUser.c_str(), config.mqttPassword.c_str())) {
-            Serial.println("MQTT connected.");
-            _mqttClient.subscribe("paketkasten/command");
-            publishState();
-        } else {
-            Serial.print("MQTT connection failed, rc=");
-            Serial.println(_mqttClient.state());
-        }
+    if (!_mqttClient.connect("Paketkasten", config.mqttUser, config.mqttPassword)) {
+        Serial.printf("MQTT: broker refused connection, rc=%d\n", _mqttClient.state());
+        return false;
     }
+    return true;
 }
 
-void MqttManager::handleQueue() {
-    if (_mqttClient.connected() && xSemaphoreTake(mqttQueueMutex, pdMS_TO_TICKS(10)) == pdTRUE) {
-        if (!mqttMessageQueue.empty()) {
-            std::vector<String> localQueue = mqttMessageQueue;
-            mqttMessageQueue.clear();
-            xSemaphoreGive(mqttQueueMutex);
+bool MqttManager::loop() {
+    return _mqttClient.loop();
+}
 
-            String stateTopic = "paketkasten/state";
-            for (const auto& msg : localQueue) {
-                Serial.print("Publishing state to MQTT: ");
-                Serial.println(msg);
-                _mqttClient.publish(stateTopic.c_str(), msg.c_str());
-            }
-        } else {
-            xSemaphoreGive(mqttQueueMutex);
-        }
+bool MqttManager::publish(const char* topic, const uint8_t* payload, size_t length) {
+    if (length > 0 && payload[0] == '{') {
+        Serial.printf("Publishing to MQTT %s: %.*s\n", topic, (int)length, reinterpret_cast<const char*>(payload));
+    } else {
+        Serial.printf("Publishing to MQTT %s: %u bytes\n", topic, (unsigned)length);
+    }
+    return _mqttClient.publish(topic, payload, length);
+}
+
+void MqttManager::close() {
+    _netClient->stop();
+}
+
+void MqttManager::onAttemptStarted() {
+    Serial.println("Attempting MQTT connection...");
+}
+
+void MqttManager::onConnected(uint32_t connectMs) {
+    Serial.printf("MQTT connected in %lu ms.\n", (unsigned long)connectMs);
+    bootTimeline.mark(BootPhase::MQTT_CONNECTED);
+    _mqttClient.subscribe("paketkasten/command");
+    publishSchema();
+    publishState();
+}
+
+void MqttManager::onAttemptFailed(uint16_t failures, uint32_t retryInMs) {
+    Serial.printf("MQTT connection failed (%u in a row), retrying in %lu ms\n", (unsigned)failures, (unsigned long)retryInMs);
+}
+
+void MqttManager::onConnectionLost() {
+    Serial.printf("MQTT connection lost, rc=%d\n", _mqttClient.state());
+}
+
+// Retained, so a gateway learns the layout of this box before its first state message
+void MqttManager::publishSchema() {
+    uint8_t encoding = configManager.getConfig().mqttEncoding;
+    JsonDocument doc;
+    doc["schema"] = MQTT_SCHEMA_VERSION;
+    JsonObject topics = doc["state"].to<JsonObject>();
+    if (encoding != MQTT_ENCODING_MSGPACK) {
+        topics["json"] = mqttTopicName(MQTT_TOPIC_STATE);
+    }
+    if (encoding == MQTT_ENCODING_MSGPACK || encoding == MQTT_ENCODING_BOTH) {
+        topics["msgpack"] = mqttTopicName(MQTT_TOPIC_STATE_MSGPACK);
     }
+    doc["command"] = "paketkasten/command";
+    doc["response"] = mqttTopicName(MQTT_TOPIC_RESPONSE);
+    char payload[256];
+    size_t length = serializeJson(doc, payload, sizeof(payload));
+    _mqttClient.publish("paketkasten/schema", reinterpret_cast<const uint8_t*>(payload), length, true);
 }
 
 void MqttManager::update() {
-    Config& config = configManager.getConfig();
-    if (config.mqttServer != "" && _netClient != nullptr) {
-        _mqttClient.loop();
-        if (!_mqttClient.connected()) {
-            reconnect();
+    // The connect task still owns the client; rebuild it once the attempt is over
+    if (_reconfigureRequested && _session.state() != MqttState::CONNECTING) {
+        _reconfigureRequested = false;
+        Serial.println("MQTT settings changed, reconnecting to broker.");
+        if (_mqttClient.connected()) {
+            _mqttClient.disconnect();
         }
-        handleQueue();
+        setupClient();
     }
+
+    _session.update(millis(), esp_random());
 }
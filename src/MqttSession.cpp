@@ -0,0 +1,137 @@
+#include "MqttSession.h"
+
+MqttSession::MqttSession(MqttOutbox& outbox, MqttLink& link, MqttSpool* spool) :
+    _outbox(outbox),
+    _link(link),
+    _spool(spool)
+{}
+
+const char* MqttSession::stateName(MqttState state) {
+    switch (state) {
+        case MqttState::DISABLED: return "disabled";
+        case MqttState::WAITING: return "waiting";
+        case MqttState::CONNECTING: return "connecting";
+        case MqttState::CONNECTED: return "connected";
+        default: return "unknown";
+    }
+}
+
+void MqttSession::reset(bool enabled, uint32_t now) {
+    _backoff.reset();
+    _waitUntil = now;
+    _state = enabled ? MqttState::WAITING : MqttState::DISABLED;
+}
+
+void MqttSession::update(uint32_t now, uint32_t random) {
+    switch (_state) {
+        case MqttState::DISABLED:
+            return;
+        case MqttState::WAITING:
+            if (_link.networkUp() && (int32_t)(now - _waitUntil) >= 0) {
+                startAttempt(now);
+            }
+            break;
+        case MqttState::CONNECTING: {
+            int result = _link.connectResult();
+            if (result != 0) {
+                finishAttempt(result, now, random);
+            }
+            break;
+        }
+        case MqttState::CONNECTED:
+            if (!_link.loop()) {
+                _link.close();
+                _link.onConnectionLost();
+                // The first retry after a loss is immediate; the backoff covers the rest
+                _waitUntil = now;
+                _state = MqttState::WAITING;
+                break;
+            }
+            replay(now);
+            break;
+    }
+    drain();
+}
+
+void MqttSession::startAttempt(uint32_t now) {
+    _link.onAttemptStarted();
+    _attemptStartedAt = now;
+    _state = MqttState::CONNECTING;
+    _link.beginConnect();
+}
+
+void MqttSession::finishAttempt(int result, uint32_t now, uint32_t random) {
+    // The transport is already up, so the handshake only exchanges CONNECT/CONNACK
+    if (result < 0 || !_link.handshake()) {
+        attemptFailed(now, random);
+        return;
+    }
+    _lastConnectMs = now - _attemptStartedAt;
+    if (_lastConnectMs > _maxConnectMs) {
+        _maxConnectMs = _lastConnectMs;
+    }
+    _connects++;
+    _backoff.reset();
+    _state = MqttState::CONNECTED;
+    _link.onConnected(_lastConnectMs);
+}
+
+void MqttSession::attemptFailed(uint32_t now, uint32_t random) {
+    _connectFailures++;
+    _link.close();
+    uint32_t delayMs = _backoff.next(random);
+    _waitUntil = now + delayMs;
+    _state = MqttState::WAITING;
+    _link.onAttemptFailed(_backoff.failures(), delayMs);
+}
+
+bool MqttSession::publish(const MqttOutbox::Message& message) {
+    const char* topic = mqttTopicName(message.kind);
+    // Unknown kinds are skipped rather than blocking the queue
+    if (topic == nullptr) {
+        return true;
+    }
+    if (!_link.publish(topic, reinterpret_cast<const uint8_t*>(message.data), message.length)) {
+        return false;
+    }
+    _published++;
+    return true;
+}
+
+void MqttSession::replay(uint32_t now) {
+    if (_spool == nullptr || _spool->empty() || now - _lastReplayAt < REPLAY_INTERVAL_MS) {
+        return;
+    }
+    _lastReplayAt = now;
+    MqttOutbox::Message message;
+    for (uint8_t i = 0; i < REPLAY_BATCH && _spool->peek(message); ++i) {
+        if (!publish(message)) {
+            return;
+        }
+        _spool->consume();
+        _replayed++;
+    }
+}
+
+void MqttSession::drain() {
+    // Anything behind a spooled message is spooled too, so the order holds
+    bool direct = _state == MqttState::CONNECTED && (_spool == nullptr || _spool->empty());
+    if (!direct && _spool == nullptr) {
+        return;
+    }
+    MqttOutbox::Message message;
+    while (_outbox.pop(message)) {
+        if (direct && publish(message)) {
+            continue;
+        }
+        direct = false;
+        if (_spool == nullptr) {
+            // A failed publish without a spool; the rest waits for the next update
+            _lost++;
+            return;
+        }
+        if (!_spool->append(message.kind, message.data, message.length)) {
+            _lost++;
+        }
+    }
+}
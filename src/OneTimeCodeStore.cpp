@@ -0,0 +1,100 @@
+#include "OneTimeCodeStore.h"
+#include <ArduinoJson.h>
+
+OneTimeCodeStore::OneTimeCodeStore() :
+    _listId(0)
+{}
+
+bool OneTimeCodeStore::load(const char* listJson, uint32_t listId) {
+    CredentialIndex codes;
+    std::vector<bool> redeemed;
+
+    JsonDocument doc;
+    DeserializationError error = deserializeJson(doc, listJson ? listJson : "[]");
+    if (error) {
+        return false;
+    }
+
+    uint16_t slot = 0;
+    for (JsonObject obj : doc.as<JsonArray>()) {
+        const char* code = obj["code"];
+        const char* label = obj["label"];
+        if (code) {
+            codes.add(code, label, CredentialGroup::ONE_TIME, slot);
+        }
+        redeemed.push_back(obj["redeemed"] | false);
+        slot++;
+    }
+    codes.finalize();
+
+    for (CredentialRecord& record : codes.records()) {
+        if (redeemed[record.slot]) {
+            record.flags |= CredentialIndex::FLAG_REDEEMED;
+        }
+    }
+    assign(std::move(codes), listId);
+    return true;
+}
+
+void OneTimeCodeStore::assign(CredentialIndex&& codes, uint32_t listId) {
+    _codes = std::move(codes);
+    _listId = listId;
+    _redeemed.clear();
+    for (const CredentialRecord& record : _codes.records()) {
+        if (record.slot >= _redeemed.size()) {
+            _redeemed.resize(record.slot + 1, false);
+        }
+        _redeemed[record.slot] = (record.flags & CredentialIndex::FLAG_REDEEMED) != 0;
+    }
+}
+
+RedeemResult OneTimeCodeStore::redeem(const Credential& credential, bool deliveryBlocked, uint32_t now, const char** labelOut, RedemptionRecord* recordOut) {
+    const CredentialRecord* record = credential.isValid() ? _codes.find(credential.value(), credential.digits) : nullptr;
+    if (!record) {
+        return RedeemResult::NOT_FOUND;
+    }
+    if (_redeemed[record->slot]) {
+        return RedeemResult::ALREADY_REDEEMED;
+    }
+    if (deliveryBlocked) {
+        return RedeemResult::BLOCKED;
+    }
+
+    _redeemed[record->slot] = true;
+    if (labelOut) {
+        const char* label = _codes.label(*record);
+        *labelOut = label ? label : "One-Time Code";
+    }
+    if (recordOut) {
+        recordOut->listId = _listId;
+        recordOut->slot = record->slot;
+        recordOut->reserved = 0;
+        recordOut->redeemedAt = now;
+    }
+    return RedeemResult::REDEEMED;
+}
+
+bool OneTimeCodeStore::apply(const RedemptionRecord& record) {
+    if (record.listId != _listId || record.slot >= _redeemed.size()) {
+        return false;
+    }
+    _redeemed[record.slot] = true;
+    return true;
+}
+
+std::vector<size_t> OneTimeCodeStore::foldRedemptions() {
+    std::vector<size_t> changed;
+    std::vector<CredentialRecord>& records = _codes.records();
+    for (size_t i = 0; i < records.size(); i++) {
+        CredentialRecord& record = records[i];
+        if (_redeemed[record.slot] && !(record.flags & CredentialIndex::FLAG_REDEEMED)) {
+            record.flags |= CredentialIndex::FLAG_REDEEMED;
+            changed.push_back(i);
+        }
+    }
+    return changed;
+}
+
+void OneTimeCodeStore::toJson(std::string& out) const {
+    _codes.toJson(CredentialGroup::ONE_TIME, out, &_redeemed);
+}
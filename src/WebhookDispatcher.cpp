@@ -0,0 +1,409 @@
+#include "WebhookDispatcher.h"
+#include "ConfigManager.h"
+#include "CertStore.h"
+#include <FS.h>
+#include <LittleFS.h>
+#include <ArduinoJson.h>
+
+WebhookDispatcher webhookDispatcher;
+
+// "https://host:port" of a URL, "" if it has no scheme
+static String urlOrigin(const char* url) {
+    const char* host = strstr(url, "://");
+    if (!host) {
+        return "";
+    }
+    const char* path = strchr(host + 3, '/');
+    return path ? String(url).substring(0, path - url) : String(url);
+}
+
+static const char* const EVENT_NAMES[] = { "open", "opened", "locked", "error" };
+// Sinks without a "body" POST the batch; an empty body sends a GET instead
+static const char* const DEFAULT_BODY = "{\"device\":\"paketkasten\",\"events\":{events}}";
+
+void WebhookDispatcher::begin() {
+    _queue = xQueueCreate(QUEUE_LENGTH, sizeof(WebhookEvent));
+    _mutex = xSemaphoreCreateMutex();
+    loadSinks();
+    // Core 0 with the network stack; only routes events, the sink tasks do the I/O
+    xTaskCreatePinnedToCore(workerTask, "WebhookTask", 4096, this, 1, NULL, 0);
+}
+
+bool WebhookDispatcher::enqueue(const char* type, const char* compartment, const char* source, const char* label) {
+    WebhookEvent event = {};
+    strncpy(event.type, type, sizeof(event.type) - 1);
+    strncpy(event.compartment, compartment, sizeof(event.compartment) - 1);
+    strncpy(event.requester, label[0] ? label : source, sizeof(event.requester) - 1);
+    strncpy(event.label, label, sizeof(event.label) - 1);
+    strncpy(event.source, source, sizeof(event.source) - 1);
+    event.at = millis();
+    if (_queue == nullptr || xQueueSend(_queue, &event, 0) != pdTRUE) {
+        _dropped++;
+        Serial.println("Webhook queue full, event dropped.");
+        return false;
+    }
+    return true;
+}
+
+uint32_t WebhookDispatcher::queueDepth() const {
+    return _queue ? uxQueueMessagesWaiting(_queue) : 0;
+}
+
+void WebhookDispatcher::workerTask(void* param) {
+    static_cast<WebhookDispatcher*>(param)->run();
+}
+
+void WebhookDispatcher::run() {
+    _lastState = currentState;
+    for (;;) {
+        WebhookEvent event;
+        // Short waits so state transitions are picked up promptly
+        if (xQueueReceive(_queue, &event, pdMS_TO_TICKS(POLL_MS)) == pdTRUE) {
+            distribute(event);
+        }
+        pollState();
+
+        if (_reconfigureRequested) {
+            _reconfigureRequested = false;
+            loadSinks();
+        }
+    }
+}
+
+void WebhookDispatcher::sinkTask(void* param) {
+    WebhookSink* sink = static_cast<WebhookSink*>(param);
+    sink->dispatcher->runSink(*sink);
+    // Replaced by loadSinks(), which handed the sink over to this task
+    resetClient(*sink);
+    delete sink;
+    vTaskDelete(NULL);
+}
+
+void WebhookDispatcher::runSink(WebhookSink& sink) {
+    std::vector<WebhookEvent> batch;
+    for (;;) {
+        TickType_t wait = portMAX_DELAY;
+        xSemaphoreTake(_mutex, portMAX_DELAY);
+        if (sink.stopping) {
+            xSemaphoreGive(_mutex);
+            return;
+        }
+        batch.clear();
+        if (!sink.pending.empty()) {
+            int32_t due = (int32_t)(sink.readyAt - millis());
+            if (due > 0) {
+                wait = pdMS_TO_TICKS(due);
+            } else {
+                // A GET has no body to carry a batch, so it sends one request per event
+                sink.inFlight = sink.body.empty() ? 1 : sink.pending.size();
+                batch.assign(sink.pending.begin(), sink.pending.begin() + sink.inFlight);
+            }
+        }
+        xSemaphoreGive(_mutex);
+
+        if (batch.empty()) {
+            // distribute() and loadSinks() notify; a notification given meanwhile is not lost
+            ulTaskNotifyTake(pdTRUE, wait);
+            continue;
+        }
+        bool ok = WiFi.status() == WL_CONNECTED && deliver(sink, batch.data(), batch.size());
+        finish(sink, batch.front().at, ok);
+    }
+}
+
+// Openings are enqueued by the requesters; the later steps are read off the state machine
+void WebhookDispatcher::pollState() {
+    MailboxState state = currentState;
+    if (state == _lastState) {
+        return;
+    }
+    MailboxState previous = _lastState;
+    _lastState = state;
+
+    WebhookEvent event = {};
+    event.at = millis();
+    memcpy(event.requester, _lastOpen.requester, sizeof(event.requester));
+    memcpy(event.label, _lastOpen.label, sizeof(event.label));
+    memcpy(event.source, _lastOpen.source, sizeof(event.source));
+    if (state == PARCEL_OPEN || state == MAIL_OPEN) {
+        strncpy(event.type, "opened", sizeof(event.type) - 1);
+        strncpy(event.compartment, state == PARCEL_OPEN ? "parcel" : "mail", sizeof(event.compartment) - 1);
+    } else if (state == LOCKED && previous == LOCKING) {
+        strncpy(event.type, "locked", sizeof(event.type) - 1);
+    } else if (state == MOTOR_ERROR) {
+        strncpy(event.type, "error", sizeof(event.type) - 1);
+    } else {
+        return;
+    }
+    distribute(event);
+}
+
+void WebhookDispatcher::distribute(const WebhookEvent& event) {
+    uint32_t bit = webhookEventBit(event.type);
+    if (bit == WEBHOOK_OPEN) {
+        _lastOpen = event;
+    }
+    xSemaphoreTake(_mutex, portMAX_DELAY);
+    for (auto& sink : _sinks) {
+        if (!(sink->eventMask & bit)) {
+            continue;
+        }
+        if (sink->pending.empty()) {
+            sink->readyAt = event.at + sink->batchMs;
+        }
+        if (sink->pending.size() >= MAX_PENDING) {
+            // A sink that is down keeps the newest events, but never loses the ones being sent
+            sink->dropped++;
+            _dropped++;
+            if (sink->inFlight >= sink->pending.size()) {
+                continue;
+            }
+            sink->pending.erase(sink->pending.begin() + sink->inFlight);
+        }
+        sink->pending.push_back(event);
+        xTaskNotifyGive(sink->task);
+    }
+    xSemaphoreGive(_mutex);
+}
+
+// Runs on the sink's task once a request for the first inFlight events is done
+void WebhookDispatcher::finish(WebhookSink& sink, uint32_t firstAt, bool ok) {
+    xSemaphoreTake(_mutex, portMAX_DELAY);
+    size_t count = sink.inFlight;
+    sink.inFlight = 0;
+    if (ok) {
+        uint32_t latency = millis() - firstAt;
+        sink.lastLatencyMs = latency;
+        _lastLatencyMs = latency;
+        if (latency > _maxLatencyMs) {
+            _maxLatencyMs = latency;
+        }
+        sink.delivered++;
+        _delivered++;
+        sink.pending.erase(sink.pending.begin(), sink.pending.begin() + count);
+        sink.attempts = 0;
+        sink.backoff.reset();
+        // Events that came in meanwhile are batched from the first of them on
+        if (!sink.pending.empty()) {
+            sink.readyAt = sink.pending.front().at + sink.batchMs;
+        }
+    } else if (++sink.attempts < MAX_ATTEMPTS) {
+        _retries++;
+        uint32_t delayMs = sink.backoff.next(esp_random());
+        Serial.printf("Webhook %s failed, retrying in %lu ms\n", sink.name.c_str(), (unsigned long)delayMs);
+        sink.readyAt = millis() + delayMs;
+    } else {
+        Serial.printf("Webhook %s given up after %u attempts\n", sink.name.c_str(), MAX_ATTEMPTS);
+        sink.failed++;
+        _failed++;
+        sink.pending.clear();
+        sink.attempts = 0;
+        sink.backoff.reset();
+    }
+    xSemaphoreGive(_mutex);
+}
+
+bool WebhookDispatcher::deliver(WebhookSink& sink, const WebhookEvent* events, size_t count) {
+    std::string url = renderWebhookTemplate(sink.url.c_str(), events, count, TemplateEscape::URL);
+    bool secure = strncmp(url.c_str(), "https://", 8) == 0;
+    String origin = urlOrigin(url.c_str());
+    if (!sink.client || secure != sink.secure) {
+        resetClient(sink);
+        if (secure) {
+            WiFiClientSecure* client = new WiFiClientSecure();
+            sink.caCert = certStore.pem(CertId::CALLBACK_CA);
+            if (sink.insecure) {
+                client->setInsecure();
+            } else if (!sink.caCert->empty()) {
+                client->setCACert(sink.caCert->c_str());
+            } else {
+                Serial.printf("Webhook %s: HTTPS requested but no CA certificate found. Falling back to insecure mode.\n", sink.name.c_str());
+                client->setInsecure();
+            }
+            sink.client.reset(client);
+        } else {
+            sink.client.reset(new WiFiClient());
+        }
+        sink.http.reset(new HTTPClient());
+        sink.http->setReuse(true);
+        sink.http->setTimeout(TIMEOUT_MS);
+        sink.http->setConnectTimeout(TIMEOUT_MS);
+        sink.secure = secure;
+    } else if (origin != sink.origin) {
+        // Kept-alive socket belongs to another host
+        sink.client->stop();
+    }
+    sink.origin = origin;
+
+    if (!sink.http->begin(*sink.client, url.c_str())) {
+        Serial.printf("Webhook %s: failed to initiate connection\n", sink.name.c_str());
+        return false;
+    }
+    int httpCode;
+    if (sink.body.empty()) {
+        httpCode = sink.http->GET();
+    } else {
+        std::string body = renderWebhookTemplate(sink.body.c_str(), events, count, TemplateEscape::JSON);
+        sink.http->addHeader("Content-Type", "application/json");
+        httpCode = sink.http->POST(reinterpret_cast<uint8_t*>(&body[0]), body.size());
+    }
+    if (httpCode > 0) {
+        Serial.printf("Webhook %s: %u event(s), response code %d\n", sink.name.c_str(), (unsigned)count, httpCode);
+        // Drain the body so the connection can be reused
+        sink.http->getString();
+    } else {
+        Serial.printf("Webhook %s: %s\n", sink.name.c_str(), sink.http->errorToString(httpCode).c_str());
+        sink.client->stop();
+    }
+    sink.http->end();
+    return httpCode > 0 && httpCode < 500;
+}
+
+void WebhookDispatcher::resetClient(WebhookSink& sink) {
+    if (sink.client) {
+        sink.client->stop();
+    }
+    sink.http.reset();
+    sink.client.reset();
+    sink.caCert.reset();
+    sink.origin = "";
+}
+
+// Runs on the worker (and once in begin()); pending events of the old sinks are dropped
+void WebhookDispatcher::loadSinks() {
+    std::vector<std::unique_ptr<WebhookSink>> sinks;
+
+    Config& config = configManager.getConfig();
+    if (config.callbackUrl[0] != '\0') {
+        std::unique_ptr<WebhookSink> sink(new WebhookSink());
+        sink->name = "callback";
+        sink->builtin = true;
+        // The old single callback: GET with {compartment} on every opening
+        sink->url = config.callbackUrl;
+        sink->eventMask = WEBHOOK_OPEN;
+        sink->insecure = config.callbackSkipCertVal;
+        sinks.push_back(std::move(sink));
+    }
+
+    if (LittleFS.exists(WEBHOOKS_PATH)) {
+        File file = LittleFS.open(WEBHOOKS_PATH, "r");
+        JsonDocument doc;
+        if (file && deserializeJson(doc, file) == DeserializationError::Ok) {
+            uint8_t count = 0;
+            for (JsonObject item : doc.as<JsonArray>()) {
+                if (count++ >= MAX_SINKS) {
+                    break;
+                }
+                std::unique_ptr<WebhookSink> sink(new WebhookSink());
+                sink->name = item["name"] | "webhook";
+                sink->url = item["url"] | "";
+                sink->body = item["body"] | DEFAULT_BODY;
+                sink->batchMs = item["batch_ms"] | 0;
+                sink->insecure = item["insecure"] | false;
+                if (item["events"].is<JsonArray>()) {
+                    sink->eventMask = 0;
+                    for (const char* type : item["events"].as<JsonArray>()) {
+                        sink->eventMask |= webhookEventBit(type ? type : "");
+                    }
+                }
+                sinks.push_back(std::move(sink));
+            }
+        }
+        file.close();
+    }
+
+    for (auto it = sinks.begin(); it != sinks.end();) {
+        WebhookSink& sink = **it;
+        sink.dispatcher = this;
+        if (xTaskCreatePinnedToCore(sinkTask, "WebhookSink", SINK_STACK, &sink, 1, &sink.task, 0) != pdPASS) {
+            Serial.printf("Webhook %s: no memory for its task, skipped\n", sink.name.c_str());
+            it = sinks.erase(it);
+            continue;
+        }
+        ++it;
+    }
+
+    xSemaphoreTake(_mutex, portMAX_DELAY);
+    _sinks.swap(sinks);
+    // Each old sink's task finishes the request it is in, if any, and then deletes it
+    for (auto& sink : sinks) {
+        sink->stopping = true;
+        xTaskNotifyGive(sink->task);
+        sink.release();
+    }
+    xSemaphoreGive(_mutex);
+    Serial.printf("Webhooks: %u sink(s) configured\n", (unsigned)_sinks.size());
+}
+
+const char* WebhookDispatcher::saveSinks(const char* json) {
+    JsonDocument doc;
+    if (deserializeJson(doc, json) != DeserializationError::Ok || !doc.is<JsonArray>()) {
+        return "Expected a JSON array of sinks";
+    }
+    JsonArray items = doc.as<JsonArray>();
+    if (items.size() > MAX_SINKS) {
+        return "Too many sinks";
+    }
+    for (JsonObject item : items) {
+        if (item["builtin"] | false) {
+            return "The callback sink is set with the Callback URL setting";
+        }
+        const char* url = item["url"] | "";
+        if (strncmp(url, "http://", 7) != 0 && strncmp(url, "https://", 8) != 0) {
+            return "Every sink needs an http:// or https:// url";
+        }
+        if ((item["batch_ms"] | 0UL) > MAX_BATCH_MS) {
+            return "batch_ms is limited to 60000";
+        }
+        if (item["events"].is<JsonArray>()) {
+            for (const char* type : item["events"].as<JsonArray>()) {
+                if (!type || webhookEventBit(type) == 0) {
+                    return "Unknown event type";
+                }
+            }
+        }
+    }
+
+    File file = LittleFS.open(WEBHOOKS_PATH, "w");
+    if (!file) {
+        return "Could not write the sink list";
+    }
+    serializeJson(doc, file);
+    file.close();
+    requestReconfigure();
+    return nullptr;
+}
+
+String WebhookDispatcher::statusJson() {
+    JsonDocument doc;
+    JsonArray sinks = doc["sinks"].to<JsonArray>();
+    xSemaphoreTake(_mutex, portMAX_DELAY);
+    for (const auto& sink : _sinks) {
+        JsonObject item = sinks.add<JsonObject>();
+        item["name"] = sink->name;
+        if (sink->builtin) {
+            item["builtin"] = true;
+        }
+        item["url"] = sink->url;
+        if (!sink->body.empty()) {
+            item["body"] = sink->body;
+        }
+        JsonArray events = item["events"].to<JsonArray>();
+        for (uint8_t i = 0; i < sizeof(EVENT_NAMES) / sizeof(EVENT_NAMES[0]); i++) {
+            if (sink->eventMask & (1u << i)) {
+                events.add(EVENT_NAMES[i]);
+            }
+        }
+        item["batch_ms"] = sink->batchMs;
+        item["insecure"] = sink->insecure;
+        item["pending"] = sink->pending.size();
+        item["delivered"] = sink->delivered;
+        item["failed"] = sink->failed;
+        item["dropped"] = sink->dropped;
+        item["last_latency_ms"] = sink->lastLatencyMs;
+    }
+    xSemaphoreGive(_mutex);
+    String json;
+    serializeJson(doc, json);
+    return json;
+}
@@ -0,0 +1,127 @@
+#include "WebhookTemplate.h"
+#include <cstdio>
+#include <cstring>
+
+uint32_t webhookEventBit(const char* type) {
+    if (strcmp(type, "open") == 0) {
+        return WEBHOOK_OPEN;
+    } else if (strcmp(type, "opened") == 0) {
+        return WEBHOOK_OPENED;
+    } else if (strcmp(type, "locked") == 0) {
+        return WEBHOOK_LOCKED;
+    } else if (strcmp(type, "error") == 0) {
+        return WEBHOOK_ERROR;
+    }
+    return 0;
+}
+
+static void appendJsonEscaped(std::string& out, const char* value) {
+    for (const char* p = value; *p; ++p) {
+        char c = *p;
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            char escaped[7];
+            snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+            out += escaped;
+        } else {
+            out += c;
+        }
+    }
+}
+
+static void appendUrlEncoded(std::string& out, const char* value) {
+    static const char* const HEX_DIGITS = "0123456789ABCDEF";
+    for (const char* p = value; *p; ++p) {
+        unsigned char c = static_cast<unsigned char>(*p);
+        if ((c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') ||
+            c == '-' || c == '_' || c == '.' || c == '~') {
+            out += static_cast<char>(c);
+        } else {
+            out += '%';
+            out += HEX_DIGITS[c >> 4];
+            out += HEX_DIGITS[c & 0x0F];
+        }
+    }
+}
+
+static void appendValue(std::string& out, const char* value, TemplateEscape escape) {
+    if (escape == TemplateEscape::JSON) {
+        appendJsonEscaped(out, value);
+    } else {
+        appendUrlEncoded(out, value);
+    }
+}
+
+static std::string eventsJson(const WebhookEvent* events, size_t count) {
+    std::string json = "[";
+    for (size_t i = 0; i < count; ++i) {
+        if (i > 0) {
+            json += ',';
+        }
+        json += "{\"event\":\"";
+        appendJsonEscaped(json, events[i].type);
+        json += "\",\"compartment\":\"";
+        appendJsonEscaped(json, events[i].compartment);
+        json += "\",\"requester\":\"";
+        appendJsonEscaped(json, events[i].requester);
+        json += "\",\"label\":\"";
+        appendJsonEscaped(json, events[i].label);
+        json += "\",\"source\":\"";
+        appendJsonEscaped(json, events[i].source);
+        char time[24];
+        snprintf(time, sizeof(time), "\",\"time\":%lu}", (unsigned long)events[i].at);
+        json += time;
+    }
+    json += ']';
+    return json;
+}
+
+std::string renderWebhookTemplate(const char* tmpl, const WebhookEvent* events, size_t count, TemplateEscape escape) {
+    static const WebhookEvent EMPTY = {};
+    const WebhookEvent& last = count > 0 ? events[count - 1] : EMPTY;
+    std::string out;
+    out.reserve(strlen(tmpl) + 32);
+
+    const char* p = tmpl;
+    while (*p) {
+        const char* close = *p == '{' ? strchr(p, '}') : nullptr;
+        if (!close) {
+            out += *p++;
+            continue;
+        }
+        std::string name(p + 1, close - p - 1);
+        char number[12];
+        if (name == "event") {
+            appendValue(out, last.type, escape);
+        } else if (name == "compartment") {
+            appendValue(out, last.compartment, escape);
+        } else if (name == "requester") {
+            appendValue(out, last.requester, escape);
+        } else if (name == "label") {
+            appendValue(out, last.label, escape);
+        } else if (name == "source") {
+            appendValue(out, last.source, escape);
+        } else if (name == "time") {
+            snprintf(number, sizeof(number), "%lu", (unsigned long)last.at);
+            out += number;
+        } else if (name == "count") {
+            snprintf(number, sizeof(number), "%u", (unsigned)count);
+            out += number;
+        } else if (name == "events") {
+            std::string json = eventsJson(events, count);
+            if (escape == TemplateEscape::JSON) {
+                out += json;
+            } else {
+                appendUrlEncoded(out, json.c_str());
+            }
+        } else {
+            // Not a placeholder (e.g. a literal JSON brace); keep the brace and go on
+            out += *p++;
+            continue;
+        }
+        p = close + 1;
+    }
+    return out;
+}
@@ -0,0 +1,63 @@
+#include "WiegandDecoder.h"
+
+WiegandDecoder::WiegandDecoder() :
+    _keypadPin(0),
+    _keypadPinLen(0),
+    _lastKeypadPressTime(0)
+{}
+
+bool WiegandDecoder::expire(unsigned long now) {
+    if (_keypadPinLen > 0 && (now - _lastKeypadPressTime > KEYPAD_TIMEOUT_MS)) {
+        _keypadPin = 0;
+        _keypadPinLen = 0;
+        return true;
+    }
+    return false;
+}
+
+WiegandFrame WiegandDecoder::decode(uint64_t rawCode, uint8_t bitCount, unsigned long now, Credential& credentialOut) {
+    if (bitCount == 4 || bitCount == 8) {
+        uint8_t key = 0xFF;
+        if (bitCount == 4) {
+            key = rawCode & 0x0F;
+        } else { // bitCount == 8
+            uint8_t lowNibble = rawCode & 0x0F;
+            uint8_t highNibble = (rawCode & 0xF0) >> 4;
+            if (lowNibble == ((~highNibble) & 0x0F)) {
+                key = lowNibble;
+            }
+        }
+
+        if (key == 0xFF) {
+            return WiegandFrame::IGNORED;
+        }
+        if (key < 10) {
+            if (_keypadPinLen < MAX_PIN_DIGITS) {
+                _keypadPin = (_keypadPin << 4) | key;
+                _keypadPinLen++;
+                _lastKeypadPressTime = now;
+                return WiegandFrame::KEY_DIGIT;
+            }
+            return WiegandFrame::IGNORED;
+        }
+
+        // Termination key (* or #)
+        if (_keypadPinLen == 0) {
+            return WiegandFrame::IGNORED;
+        }
+        credentialOut = Credential::fromValue(_keypadPin, bitCount, _keypadPinLen);
+        _keypadPin = 0;
+        _keypadPinLen = 0;
+        return WiegandFrame::KEYPAD_PIN;
+    }
+
+    uint64_t processedCode = rawCode;
+    if (bitCount == 26) {
+        processedCode = (rawCode >> 1) & 0xFFFFFF; // Extract full 24-bit data (no 16-bit truncation)
+    } else if (bitCount == 34) {
+        processedCode = (rawCode >> 1) & 0xFFFFFFFF; // Extract full 32-bit data
+    }
+
+    credentialOut = Credential::fromValue(processedCode, bitCount);
+    return WiegandFrame::CARD;
+}
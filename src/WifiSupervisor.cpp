@@ -0,0 +1,225 @@
+#include "WifiSupervisor.h"
+#include "ConfigManager.h"
+#include "BootTimeline.h"
+#include "Crc32.h"
+#include "state.h"
+#include <WiFi.h>
+#include <Preferences.h>
+
+WifiSupervisor wifiSupervisor;
+
+static const uint32_t WIFI_CACHE_MAGIC = 0x32494657; // "WFI2", without the lease of "WFIC"
+static const char* const WIFI_CACHE_KEY = "wifiCache";
+
+// Survives ESP.restart(); NVS covers power loss
+RTC_DATA_ATTR static WifiCache rtcWifiCache;
+
+static uint32_t cacheCrc(const WifiCache& cache) {
+    return crc32Update(0, &cache, offsetof(WifiCache, crc));
+}
+
+static bool cacheValid(const WifiCache& cache) {
+    return cache.magic == WIFI_CACHE_MAGIC && cache.crc == cacheCrc(cache);
+}
+
+static uint32_t ssidHash(const char* ssid) {
+    return crc32Update(0, ssid, strlen(ssid));
+}
+
+void WifiSupervisor::begin() {
+    loadCache();
+    // The supervisor owns reconnects, and the settings live in ConfigManager
+    WiFi.persistent(false);
+    WiFi.setAutoReconnect(false);
+
+    _offlineSince = millis();
+    if (configManager.getConfig().ssid[0] == '\0') {
+        startSoftAP();
+        _state = WifiState::SETUP;
+    } else {
+        WiFi.mode(WIFI_STA);
+        startAttempt();
+    }
+    xTaskCreatePinnedToCore(supervisorTask, "WifiTask", 4096, this, 1, NULL, 0);
+}
+
+void WifiSupervisor::supervisorTask(void* param) {
+    WifiSupervisor* self = static_cast<WifiSupervisor*>(param);
+    for (;;) {
+        self->update();
+        vTaskDelay(pdMS_TO_TICKS(100));
+    }
+}
+
+void WifiSupervisor::update() {
+    unsigned long now = millis();
+
+    if (_reconnectRequested) {
+        _reconnectRequested = false;
+        WiFi.disconnect();
+        _backoff.reset();
+        if (_state == WifiState::CONNECTED) {
+            _offlineSince = now;
+        }
+        if (configManager.getConfig().ssid[0] == '\0') {
+            if (!_softApActive) {
+                startSoftAP();
+            }
+            _state = WifiState::SETUP;
+        } else {
+            Serial.print("WiFi settings changed, re-joining: ");
+            Serial.println(configManager.getConfig().ssid);
+            startAttempt();
+        }
+        return;
+    }
+
+    switch (_state) {
+        case WifiState::SETUP:
+            return;
+        case WifiState::CONNECTING:
+            if (WiFi.status() == WL_CONNECTED) {
+                onConnected();
+            } else if (now - _attemptStartedAt > (_fastPath ? FAST_ATTEMPT_TIMEOUT_MS : ATTEMPT_TIMEOUT_MS)) {
+                onAttemptFailed();
+            }
+            break;
+        case WifiState::WAITING:
+            if ((long)(now - _waitUntil) >= 0) {
+                startAttempt();
+            }
+            break;
+        case WifiState::CONNECTED:
+            if (WiFi.status() != WL_CONNECTED) {
+                Serial.println("WiFi connection lost, reconnecting.");
+                _offlineSince = now;
+                _backoff.reset();
+                startAttempt();
+            } else if (_softApActive && now - _connectedAt > SOFTAP_LINGER_MS) {
+                stopSoftAP();
+            }
+            return;
+    }
+
+    if (!_softApActive && now - _offlineSince > SOFTAP_AFTER_MS) {
+        Serial.println("WiFi unavailable for 5 minutes, opening the configuration SoftAP.");
+        startSoftAP();
+    }
+}
+
+void WifiSupervisor::startAttempt() {
+    Config& config = configManager.getConfig();
+    // Only the first try after a loss uses the cache; a failed fast join falls back to a full scan
+    _fastPath = _backoff.failures() == 0 && cacheMatches();
+    if (_fastPath) {
+        Serial.printf("Joining %s on channel %u (cached BSSID)\n", config.ssid, _cache.channel);
+        WiFi.begin(config.ssid, config.password, _cache.channel, _cache.bssid);
+    } else {
+        Serial.printf("Joining %s\n", config.ssid);
+        WiFi.begin(config.ssid, config.password);
+    }
+    _attemptStartedAt = millis();
+    _state = WifiState::CONNECTING;
+}
+
+void WifiSupervisor::onConnected() {
+    unsigned long now = millis();
+    _state = WifiState::CONNECTED;
+    _connectedAt = now;
+    if (_fastPath) {
+        _fastConnects++;
+    }
+    if (_everConnected) {
+        _lastReconnectMs = now - _offlineSince;
+        if (_lastReconnectMs > _maxReconnectMs) {
+            _maxReconnectMs = _lastReconnectMs;
+        }
+        _reconnects++;
+        Serial.printf("WiFi reconnected after %lu ms\n", (unsigned long)_lastReconnectMs);
+    } else {
+        _everConnected = true;
+        bootTimeline.mark(BootPhase::WIFI_CONNECTED);
+    }
+    _backoff.reset();
+    Serial.print("Connected to WiFi, IP address: ");
+    Serial.println(WiFi.localIP());
+    storeCache();
+}
+
+void WifiSupervisor::onAttemptFailed() {
+    _failedAttempts++;
+    WiFi.disconnect();
+    uint32_t delayMs = _backoff.next(esp_random());
+    Serial.printf("WiFi join failed (%u in a row), retrying in %lu ms\n", _backoff.failures(), (unsigned long)delayMs);
+    _waitUntil = millis() + delayMs;
+    _state = WifiState::WAITING;
+}
+
+void WifiSupervisor::startSoftAP() {
+    Serial.println("Starting SoftAP for configuration.");
+    // Keep the station running so a recovering AP is still picked up
+    WiFi.mode(_state == WifiState::SETUP || configManager.getConfig().ssid[0] == '\0' ? WIFI_AP : WIFI_AP_STA);
+    WiFi.softAP("Paketkasten-Setup", SOFTAP_PASSWORD);
+    _softApActive = true;
+    bootTimeline.mark(BootPhase::SOFTAP_STARTED);
+    Serial.print("SoftAP IP address: ");
+    Serial.println(WiFi.softAPIP());
+}
+
+void WifiSupervisor::stopSoftAP() {
+    Serial.println("WiFi link stable, closing the SoftAP.");
+    WiFi.softAPdisconnect(true);
+    _softApActive = false;
+}
+
+bool WifiSupervisor::cacheMatches() const {
+    return cacheValid(_cache) && _cache.ssidHash == ssidHash(configManager.getConfig().ssid) && _cache.channel != 0;
+}
+
+void WifiSupervisor::loadCache() {
+    if (cacheValid(rtcWifiCache)) {
+        _cache = rtcWifiCache;
+        return;
+    }
+    Preferences preferences;
+    preferences.begin(PREFERENCES_NAMESPACE, true);
+    if (preferences.getBytesLength(WIFI_CACHE_KEY) == sizeof(WifiCache)) {
+        preferences.getBytes(WIFI_CACHE_KEY, &_cache, sizeof(WifiCache));
+    }
+    preferences.end();
+    if (!cacheValid(_cache)) {
+        memset(&_cache, 0, sizeof(_cache));
+    }
+}
+
+void WifiSupervisor::storeCache() {
+    WifiCache cache = {};
+    cache.magic = WIFI_CACHE_MAGIC;
+    cache.ssidHash = ssidHash(configManager.getConfig().ssid);
+    const uint8_t* bssid = WiFi.BSSID();
+    if (bssid) {
+        memcpy(cache.bssid, bssid, sizeof(cache.bssid));
+    }
+    cache.channel = WiFi.channel();
+    cache.crc = cacheCrc(cache);
+
+    rtcWifiCache = cache;
+    // NVS is only written when the association actually moved
+    if (memcmp(&cache, &_cache, sizeof(cache)) != 0) {
+        _cache = cache;
+        Preferences preferences;
+        preferences.begin(PREFERENCES_NAMESPACE, false);
+        preferences.putBytes(WIFI_CACHE_KEY, &cache, sizeof(cache));
+        preferences.end();
+    }
+}
+
+const char* WifiSupervisor::stateName(WifiState state) {
+    switch (state) {
+        case WifiState::SETUP:      return "setup";
+        case WifiState::CONNECTING: return "connecting";
+        case WifiState::WAITING:    return "waiting";
+        case WifiState::CONNECTED:  return "connected";
+        default:                    return "unknown";
+    }
+}
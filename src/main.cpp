@@ -13,23 +13,30 @@
 #include "WiegandManager.h"
 #include "MqttManager.h"
 #include "MailboxNetworkManager.h"
+#include "WifiSupervisor.h"
 #include "AccessControl.h"
+#include "HeapMonitor.h"
+#include "BootTimeline.h"
+#include "CertStore.h"
+#include "WebhookDispatcher.h"
+#include "MqttCommand.h"
+#include "CredentialStore.h"
 #include <LittleFS.h>
 #include <ArduinoJson.h>
-#include <HTTPClient.h>
-#include <WiFiClientSecure.h>
 
 // Global configurations
 int debounceDelay = 2; // in ms
 const bool INVERT_SWITCH_STATE = false;
 
 // Function declarations
-void triggerCallback(const char* compartment);
-void receivedWiegandCode(char* code, uint8_t bits);
+void receivedWiegandCode(const Credential& credential);
 void mqttCallback(char* topic, byte* payload, unsigned int length);
 void appTask(void* param);
 void mqttTask(void* param);
 
+// Woken by publishState() so transitions go out without waiting for the next poll
+static TaskHandle_t mqttTaskHandle = nullptr;
+
 void setup() {
   setCpuFrequencyMhz(160);
   Serial.begin(115200);
@@ -39,10 +46,9 @@ void setup() {
     return;
   }
 
-  // Create mutex for cross-core MQTT queue protection only
-  mqttQueueMutex = xSemaphoreCreateMutex();
-
   configManager.begin();
+  certStore.begin();
+  bootTimeline.mark(BootPhase::CONFIG_LOADED);
   Serial.println("Configuration loaded.");
   
   motorController.begin();
@@ -59,15 +65,10 @@ void setup() {
   
   melodyPlayer.begin();
   Serial.println("Buzzer setup complete.");
-  
-  mailboxNetworkManager.begin();
-  Serial.println("Web server setup complete.");
-
-  
-  mqttManager.begin(mqttCallback);
-  Serial.println("MQTT setup complete.");
+  bootTimeline.mark(BootPhase::HARDWARE_READY);
 
-  // Pin application logic to Core 1 (APP_CPU, away from WiFi on Core 0)
+  // Pin application logic to Core 1 (APP_CPU, away from WiFi on Core 0).
+  // Started before networking so the lock works while WiFi is still joining.
   xTaskCreatePinnedToCore(
     appTask,
     "AppTask",
@@ -77,18 +78,37 @@ void setup() {
     NULL,
     1                 // Core 1 (APP_CPU)
   );
+  bootTimeline.mark(BootPhase::LOCK_ONLINE);
+
+  // Returns immediately; the WiFi supervisor task joins in the background
+  mailboxNetworkManager.begin();
+  Serial.println("Web server setup complete.");
+
+  webhookDispatcher.begin();
+
+  mqttManager.begin(mqttCallback);
+  Serial.println("MQTT setup complete.");
 
-  // Pin MQTT handling to Core 0 (PRO_CPU, alongside WiFi)
+  // Motor, melody, callback and access settings are read on use; only the
+  // network clients have to be rebuilt when their settings change.
+  configManager.addListener(CONFIG_MQTT, [](uint32_t) { mqttManager.requestReconfigure(); });
+  configManager.addListener(CONFIG_WIFI, [](uint32_t) { wifiSupervisor.requestReconnect(); });
+  configManager.addListener(CONFIG_CALLBACK, [](uint32_t) { webhookDispatcher.requestReconfigure(); });
+
+  // Pin MQTT handling to Core 0 (PRO_CPU, alongside WiFi). It runs in every
+  // state; the motor loop lives on Core 1 and never waits on it.
   xTaskCreatePinnedToCore(
     mqttTask,
     "MqttTask",
     4096,             // Stack size
     NULL,
     1,                // Priority
-    NULL,
+    &mqttTaskHandle,
     0                 // Core 0 (PRO_CPU)
   );
 
+  heapMonitor.begin();
+
   Serial.println("Setup complete. Tasks pinned: AppTask->Core1, WiegandTask->Core1, MqttTask->Core0");
 }
 
@@ -99,11 +119,12 @@ void loop() {
     input.trim();
     if (input.length() > 0) {
       Serial.printf("[Wokwi Sim] Simulating Wiegand Code entry: %s\n", input.c_str());
-      input.toUpperCase();
-      char tempCode[32];
-      strncpy(tempCode, input.c_str(), sizeof(tempCode) - 1);
-      tempCode[sizeof(tempCode) - 1] = '\0';
-      receivedWiegandCode(tempCode, 26);
+      uint64_t value;
+      if (CredentialIndex::parseHex(input.c_str(), value)) {
+        receivedWiegandCode(Credential::fromValue(value, 26));
+      } else {
+        Serial.println("[Wokwi Sim] Input is not a hex code, ignored.");
+      }
     }
   }
   delay(50); // Prevent CPU hogging
@@ -129,6 +150,7 @@ void appTask(void* param) {
     melodyPlayer.update();
 
     updateCalibration();
+    heapMonitor.update();
 
     if (currentState != MOTOR_ERROR && !calibrationActive) {
       bool shouldLock = false;
@@ -176,6 +198,7 @@ void appTask(void* param) {
     }
  
     if (shouldRestart) {
+      configManager.flush();
       delay(100);
       ESP.restart();
     }
@@ -187,137 +210,85 @@ void appTask(void* param) {
 // MQTT task — pinned to Core 0 (PRO_CPU, alongside WiFi)
 void mqttTask(void* param) {
   for (;;) {
-    MailboxState localState = currentState;
-    if (localState == LOCKED || localState == MOTOR_ERROR) {
-      mqttManager.update();
-    }
-    vTaskDelay(pdMS_TO_TICKS(50)); // MQTT doesn't need sub-ms timing
-  }
-}
-
-void triggerCallback(const char* compartment) {
-  Config& config = configManager.getConfig();
-  if (config.callbackUrl.length() > 0) {
-    String url = config.callbackUrl;
-    url.replace("{compartment}", compartment);
-    HTTPClient http;
-    bool beginSuccess = false;
-
-    if (url.startsWith("https://")) {
-      WiFiClientSecure client;
-      if (config.callbackSkipCertVal) {
-        Serial.println("HTTPS Callback: Skipping certificate validation (Insecure)");
-        client.setInsecure();
-      } else {
-        String caCert = "";
-        if (LittleFS.exists("/certs/callback_ca.pem")) {
-          File file = LittleFS.open("/certs/callback_ca.pem", "r");
-          if (file) {
-            caCert = file.readString();
-            file.close();
-          }
-        }
-        if (caCert.length() > 0) {
-          Serial.println("HTTPS Callback: Setting Root CA certificate");
-          client.setCACert(caCert.c_str());
-        } else {
-          Serial.println("HTTPS Callback Warning: HTTPS requested but no CA certificate found. Falling back to insecure mode.");
-          client.setInsecure();
-        }
-      }
-      beginSuccess = http.begin(client, url);
-    } else {
-      WiFiClient client;
-      beginSuccess = http.begin(client, url);
-    }
-
-    if (beginSuccess) {
-      int httpCode = http.GET();
-      if (httpCode > 0) {
-        String payload = http.getString();
-        Serial.printf("Callback response code: %d\n", httpCode);
-        Serial.println(payload);
-      } else {
-        Serial.printf("Error on HTTP request: %s\n", http.errorToString(httpCode).c_str());
-      }
-      http.end();
-    } else {
-      Serial.println("Failed to initiate connection in HTTPClient");
-    }
+    mqttManager.update();
+    // Keepalives and incoming commands are served every 50 ms, queued state immediately
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(50));
   }
 }
 
-void requestParcelOpening(const char* requester) {
-  if (calibrationActive) return;
-  if (currentState == LOCKED && (millis() - lockedStateEnterTime > 2500)) {
-    if (strcmp(requester, "webinterface") == 0 || strcmp(requester, "mqtt") == 0) {
-      configManager.resetDeliveryBlockIfNeeded(requester);
-    }
-    triggerCallback("parcel");
-    Serial.println("Request: OPEN_PARCEL. State -> PRE_OPENING_TO_PARCEL");
-    wiegandManager.detach();
-    strncpy(lastUsed, requester, sizeof(lastUsed) - 1);
-    melodyPlayer.play(configManager.getConfig().selectedMelody);
-    preOpeningStateEnterTime = millis();
-    currentState = PRE_OPENING_TO_PARCEL;
+bool requestParcelOpening(const char* source, const char* label) {
+  if (calibrationActive) return false;
+  if (currentState != LOCKED || millis() - lockedStateEnterTime <= 2500) return false;
+  if (strcmp(source, "webinterface") == 0 || strcmp(source, "mqtt") == 0) {
+    configManager.resetDeliveryBlockIfNeeded(source);
   }
+  webhookDispatcher.enqueue("open", "parcel", source, label);
+  Serial.println("Request: OPEN_PARCEL. State -> PRE_OPENING_TO_PARCEL");
+  wiegandManager.detach();
+  strncpy(lastUsed, label[0] ? label : source, sizeof(lastUsed) - 1);
+  melodyPlayer.play(configManager.getConfig().selectedMelody);
+  preOpeningStateEnterTime = millis();
+  currentState = PRE_OPENING_TO_PARCEL;
+  return true;
 }
 
-void requestMailOpening(const char* requester) {
-  if (calibrationActive) return;
-  if (currentState == LOCKED && (millis() - lockedStateEnterTime > 2500)) {
-    if (strcmp(requester, "webinterface") == 0 || strcmp(requester, "mqtt") == 0) {
-      configManager.resetDeliveryBlockIfNeeded(requester);
-    }
-    triggerCallback("mail");
-    Serial.println("Request: OPEN_MAIL. State -> PRE_OPENING_TO_MAIL");
-    wiegandManager.detach();
-    strncpy(lastUsed, requester, sizeof(lastUsed) - 1);
-    melodyPlayer.play(configManager.getConfig().selectedMelody);
-    preOpeningStateEnterTime = millis();
-    currentState = PRE_OPENING_TO_MAIL;
+bool requestMailOpening(const char* source, const char* label) {
+  if (calibrationActive) return false;
+  if (currentState != LOCKED || millis() - lockedStateEnterTime <= 2500) return false;
+  if (strcmp(source, "webinterface") == 0 || strcmp(source, "mqtt") == 0) {
+    configManager.resetDeliveryBlockIfNeeded(source);
   }
+  webhookDispatcher.enqueue("open", "mail", source, label);
+  Serial.println("Request: OPEN_MAIL. State -> PRE_OPENING_TO_MAIL");
+  wiegandManager.detach();
+  strncpy(lastUsed, label[0] ? label : source, sizeof(lastUsed) - 1);
+  melodyPlayer.play(configManager.getConfig().selectedMelody);
+  preOpeningStateEnterTime = millis();
+  currentState = PRE_OPENING_TO_MAIL;
+  return true;
 }
 
-void receivedWiegandCode(char* code, uint8_t bits) {
+void receivedWiegandCode(const Credential& credential) {
   if (calibrationActive) {
     Serial.println("Wiegand code ignored: calibration active");
     return;
   }
-  Serial.print("Wiegand code received: ");
-  Serial.println(code);
-  if (bits == 4 || bits == 8) {
-    strncpy(lastKeypadCode, code, sizeof(lastKeypadCode) - 1);
-    lastKeypadCode[sizeof(lastKeypadCode) - 1] = '\0';
+  Serial.printf("Wiegand credential received: %u bits, facility %u, card %llu\n",
+                credential.bits, (unsigned)credential.facility, (unsigned long long)credential.cardNumber);
+  // Stored as-is; the diagnostics page formats them on demand
+  if (credential.isKeypad()) {
+    lastKeypadCredential = credential;
   } else {
-    strncpy(lastScannedWiegandId, code, sizeof(lastScannedWiegandId) - 1);
-    lastScannedWiegandId[sizeof(lastScannedWiegandId) - 1] = '\0';
+    lastScannedCredential = credential;
   }
+  credentialScanCount++;
 
   if (currentState == LOCKED) {
-    std::string labelOut;
+    // Held to the end so labelOut stays valid across concurrent code edits
+    std::shared_ptr<const CredentialIndex> credentials = configManager.getCredentials();
+    const char* labelOut = nullptr;
     Config& config = configManager.getConfig();
-    AccessType result = AccessControl::evaluate(code, config.ownerCodes.c_str(), config.deliveryCodes.c_str(), &labelOut);
+    AccessType result = AccessControl::evaluate(credential, *credentials, &labelOut);
     
     if (result == AccessType::OPEN_MAIL) {
       if (deliveryBlocked) {
         deliveryBlocked = false;
         configManager.save();
-        Serial.printf("Delivery block reset by owner card scan (%s)\n", labelOut.c_str());
+        Serial.printf("Delivery block reset by owner card scan (%s)\n", labelOut);
       }
-      requestMailOpening(labelOut.c_str());
+      requestMailOpening("wiegand", labelOut);
       return;
     }
     
     // Check one-time codes next
-    String otcLabel;
-    if (configManager.checkAndRedeemOneTimeCode(code, otcLabel)) {
+    char otcLabel[CredentialStore::MAX_LABEL_LENGTH + 1];
+    if (configManager.checkAndRedeemOneTimeCode(credential, otcLabel, sizeof(otcLabel))) {
       if (config.oneTimeOpening) {
         deliveryBlocked = true;
         configManager.save();
         Serial.println("One-time opening delivery block activated (one-time code used).");
       }
-      requestParcelOpening(otcLabel.c_str());
+      requestParcelOpening("wiegand", otcLabel);
       return;
     }
     
@@ -332,43 +303,101 @@ void receivedWiegandCode(char* code, uint8_t bits) {
         configManager.save();
         Serial.println("One-time opening delivery block activated (delivery code used).");
       }
-      requestParcelOpening(labelOut.c_str());
+      requestParcelOpening("wiegand", labelOut);
       return;
     }
   }
 }
 
-void mqttCallback(char* topic, byte* payload, unsigned int length) {
-  if (calibrationActive) return;
-  String message;
-  for (int i = 0; i < length; i++) {
-    message += (char)payload[i];
+static const char* executeMqttCommand(const MqttCommand& command) {
+  if (calibrationActive && command.action != MqttCommandAction::GET_STATE) {
+    return "calibration in progress";
   }
-  Serial.print("MQTT message received on topic: ");
-  Serial.println(topic);
-  Serial.print("Message: ");
-  Serial.println(message);
-
-  if (String(topic) == "paketkasten/command") {
-    if (message == "OPEN_PARCEL") {
-      requestParcelOpening("mqtt");
-    } else if (message == "OPEN_MAIL") {
-      requestMailOpening("mqtt");
+  switch (command.action) {
+    case MqttCommandAction::OPEN: {
+      bool started = command.compartment.equals("parcel") ? requestParcelOpening("mqtt") : requestMailOpening("mqtt");
+      // Only a LOCKED box past its hold-off opens; anything else must not read as success
+      return started ? nullptr : "busy";
+    }
+    case MqttCommandAction::CALIBRATE:
+      startCalibration();
+      return nullptr;
+    case MqttCommandAction::PLAY_MELODY: {
+      char melody[32];
+      if (!command.melody.copyTo(melody, sizeof(melody))) {
+        return "unknown melody";
+      }
+      melodyPlayer.play(melody);
+      return nullptr;
+    }
+    case MqttCommandAction::ADD_CODE:
+    case MqttCommandAction::REVOKE_CODE: {
+      CredentialGroup group = command.group.equals("owner") ? CredentialGroup::OWNER : CredentialGroup::DELIVERY;
+      char code[CredentialStore::MAX_CODE_LENGTH + 1];
+      char label[CredentialStore::MAX_LABEL_LENGTH + 1];
+      if (!command.code.copyTo(code, sizeof(code)) || !command.label.copyTo(label, sizeof(label))) {
+        return "code or label too long";
+      }
+      CredentialUpdate result = command.action == MqttCommandAction::ADD_CODE
+          ? configManager.addCredential(group, code, label)
+          : configManager.removeCredential(group, code);
+      if (result == CredentialUpdate::NOT_FOUND) {
+        return "code not found";
+      }
+      return result == CredentialUpdate::APPLIED ? nullptr : "could not store credential";
     }
+    default:
+      return nullptr;
+  }
+}
+
+// Runs on the MQTT task inside PubSubClient::loop(); the payload is parsed in
+// its receive buffer and the reply goes out through mqttOutbox
+void mqttCallback(char* topic, byte* payload, unsigned int length) {
+  if (strcmp(topic, "paketkasten/command") != 0) {
+    return;
+  }
+  MqttCommand command;
+  const char* error = parseMqttCommand(reinterpret_cast<char*>(payload), length, command);
+  if (error == nullptr) {
+    error = executeMqttCommand(command);
+  }
+  Serial.printf("MQTT command %s: %s\n", mqttCommandName(command.action), error ? error : "ok");
+
+  char response[MqttOutbox::Message::CAPACITY];
+  size_t responseLength = formatMqttResponse(response, sizeof(response), command, error, mailboxStateName(currentState));
+  if (responseLength > 0) {
+    mqttOutbox.push(MQTT_TOPIC_RESPONSE, response, responseLength);
   }
 }
 
 void publishState() {
   JsonDocument doc;
-  doc["state"] = getMailboxStateString();
+  doc["v"] = MQTT_SCHEMA_VERSION;
+  doc["state"] = mailboxStateName(currentState);
   doc["last_used"] = lastUsed;
-  String output;
-  serializeJson(doc, output);
-  Serial.print("Queuing state for MQTT: ");
-  Serial.println(output);
-  if (xSemaphoreTake(mqttQueueMutex, pdMS_TO_TICKS(10)) == pdTRUE) {
-    mqttMessageQueue.push_back(output);
-    xSemaphoreGive(mqttQueueMutex);
+  // Transition time, so consumers can order and time events however late they arrive
+  doc["time"] = millis();
+  if (measureJson(doc) > MqttOutbox::Message::CAPACITY) {
+    Serial.println("MQTT state message too long, dropped.");
+    return;
+  }
+  char output[MqttOutbox::Message::CAPACITY + 1];
+  uint8_t encoding = configManager.getConfig().mqttEncoding;
+  // Unknown values are treated as JSON
+  if (encoding != MQTT_ENCODING_MSGPACK) {
+    size_t length = serializeJson(doc, output, sizeof(output));
+    Serial.print("Queuing state for MQTT: ");
+    Serial.println(output);
+    mqttOutbox.push(MQTT_TOPIC_STATE, output, length);
+  }
+  if (encoding == MQTT_ENCODING_MSGPACK || encoding == MQTT_ENCODING_BOTH) {
+    // MessagePack is never longer than the JSON text measured above
+    size_t length = serializeMsgPack(doc, output, sizeof(output));
+    mqttOutbox.push(MQTT_TOPIC_STATE_MSGPACK, output, length);
+  }
+  if (mqttTaskHandle != nullptr) {
+    xTaskNotifyGive(mqttTaskHandle);
   }
 }
 
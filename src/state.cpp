@@ -23,8 +23,8 @@ const char* SOFTAP_PASSWORD = "G67zC4OiB";
 // Global variables
 volatile MailboxState currentState = LOCKED;
 volatile bool deliveryBlocked = false;
-char lastScannedWiegandId[20] = "";
-char lastKeypadCode[20] = "";
+Credential lastScannedCredential = {};
+Credential lastKeypadCredential = {};
 char lastUsed[50] = "unknown";
 volatile unsigned long openStateEnterTime = 0;
 unsigned long preOpeningStateEnterTime = 0;
@@ -32,6 +32,7 @@ volatile unsigned long motorStartTime = 0;
 volatile unsigned long lockedStateEnterTime = 0;
 volatile bool wiegandAttached = true;
 volatile bool shouldRestart = false;
+volatile uint32_t credentialScanCount = 0;
 
 // Calibration variables
 volatile bool calibrationActive = false;
@@ -41,11 +42,14 @@ volatile unsigned long calibrationStepTime = 0;
 int calibratedOpen = 0;
 int calibratedClose = 0;
 
-std::vector<String> mqttMessageQueue;
-SemaphoreHandle_t mqttQueueMutex = nullptr;
+MqttOutbox mqttOutbox(OverflowPolicy::DROP_OLDEST);
 
 String getMailboxStateString() {
-  switch (currentState) {
+  return mailboxStateName(currentState);
+}
+
+const char* mailboxStateName(MailboxState state) {
+  switch (state) {
     case LOCKED: return "LOCKED";
     case PRE_OPENING_TO_PARCEL: return "PRE_OPENING_TO_PARCEL";
     case OPENING_TO_PARCEL: return "OPENING_TO_PARCEL";
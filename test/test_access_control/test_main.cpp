@@ -1,5 +1,8 @@
 #include <unity.h>
 #include "AccessControl.h"
+#include "WiegandDecoder.h"
+#include <string>
+#include <cstdio>
 
 void setUp(void) {
     // set stuff up here
@@ -79,6 +82,158 @@ void test_access_hex_stored_matches_scanned_hex(void) {
     TEST_ASSERT_EQUAL_STRING("DHL", label.c_str());
 }
 
+void test_index_owner_wins_over_delivery(void) {
+    CredentialIndex index;
+    index.addJson("[{\"code\":\"1E240\",\"label\":\"DHL\"}]", CredentialGroup::DELIVERY);
+    index.addJson("[{\"code\":\"123456\",\"label\":\"User1\"}]", CredentialGroup::OWNER);
+    index.finalize();
+    const char* label = nullptr;
+    // "1E240" matches the delivery code directly and the owner code via its decimal spelling
+    AccessType result = AccessControl::evaluate("1E240", index, &label);
+
+    TEST_ASSERT_EQUAL(static_cast<int>(AccessType::OPEN_MAIL), static_cast<int>(result));
+    TEST_ASSERT_EQUAL_STRING("User1", label);
+}
+
+void test_index_interns_labels(void) {
+    CredentialIndex index;
+    index.addJson("[{\"code\":\"111\",\"label\":\"DHL\"},{\"code\":\"222\",\"label\":\"DHL\"}]", CredentialGroup::DELIVERY);
+    index.finalize();
+    const CredentialRecord* a = index.findScanned("111");
+    const CredentialRecord* b = index.findScanned("222");
+
+    TEST_ASSERT_NOT_NULL(a);
+    TEST_ASSERT_NOT_NULL(b);
+    TEST_ASSERT_EQUAL(a->label, b->label);
+    TEST_ASSERT_EQUAL(1, a->slot + b->slot);
+}
+
+void test_index_large_list_lookup(void) {
+    CredentialIndex index;
+    char code[16];
+    for (int i = 0; i < 1000; i++) {
+        snprintf(code, sizeof(code), "%d", 500000 + i);
+        index.add(code, "Tenant", CredentialGroup::DELIVERY, i);
+    }
+    index.finalize();
+
+    // 500999 in hex is 7A507
+    TEST_ASSERT_EQUAL(static_cast<int>(AccessType::OPEN_PARCEL), static_cast<int>(AccessControl::evaluate("7A507", index)));
+    TEST_ASSERT_EQUAL(static_cast<int>(AccessType::DENIED), static_cast<int>(AccessControl::evaluate("7A508", index)));
+}
+
+void test_index_live_edits_keep_order(void) {
+    CredentialIndex index;
+    index.addJson("[{\"code\":\"300\",\"label\":\"Anna\"},{\"code\":\"100\",\"label\":\"Ben\"}]", CredentialGroup::OWNER);
+    index.finalize();
+
+    TEST_ASSERT_TRUE(index.upsert("200", "Carla", CredentialGroup::OWNER));
+    TEST_ASSERT_TRUE(index.upsert("200", "DHL", CredentialGroup::DELIVERY));
+    TEST_ASSERT_FALSE(index.upsert("100", "Benedikt", CredentialGroup::OWNER));
+    TEST_ASSERT_TRUE(index.upsert("gate", "Text", CredentialGroup::OWNER));
+    TEST_ASSERT_TRUE(index.erase("300", CredentialGroup::OWNER));
+    TEST_ASSERT_FALSE(index.erase("300", CredentialGroup::OWNER));
+    index.compactLabels();
+
+    TEST_ASSERT_EQUAL(3, index.count(CredentialGroup::OWNER));
+    TEST_ASSERT_NULL(index.findScanned("300"));
+    TEST_ASSERT_EQUAL_STRING("Benedikt", index.label(*index.findScanned("100")));
+    TEST_ASSERT_EQUAL_STRING("Carla", index.label(*index.findScanned("200")));
+    TEST_ASSERT_EQUAL_STRING("Text", index.label(*index.findText("gate")));
+    char code[24];
+    index.codeText(*index.findText("gate"), code, sizeof(code));
+    TEST_ASSERT_EQUAL_STRING("gate", code);
+    for (size_t i = 1; i < index.size(); ++i) {
+        TEST_ASSERT_TRUE(index.records()[i - 1].key <= index.records()[i].key);
+    }
+}
+
+void test_index_compacted_copy_drops_replaced_labels(void) {
+    CredentialIndex index;
+    index.addJson("[{\"code\":\"100\",\"label\":\"Anna\"},{\"code\":\"gate\",\"label\":\"Text\"}]", CredentialGroup::OWNER);
+    index.finalize();
+    size_t compactSize = index.labels().size();
+    for (int i = 0; i < 20; i++) {
+        index.upsert("100", i % 2 ? "Anna" : "Ben", CredentialGroup::OWNER);
+        index.upsert("gate", "Text", CredentialGroup::OWNER);
+    }
+    TEST_ASSERT_TRUE(index.labels().size() > 10 * compactSize);
+
+    CredentialIndex copy;
+    copy.assignCompacted(index, 100);
+    TEST_ASSERT_EQUAL(compactSize, copy.labels().size());
+    TEST_ASSERT_EQUAL(index.size(), copy.size());
+    TEST_ASSERT_EQUAL_STRING("Anna", copy.label(*copy.findScanned("100")));
+    TEST_ASSERT_EQUAL_STRING("Text", copy.label(*copy.findText("gate")));
+    char code[24];
+    copy.codeText(*copy.findText("gate"), code, sizeof(code));
+    TEST_ASSERT_EQUAL_STRING("gate", code);
+    // Room for the edit that follows the copy
+    TEST_ASSERT_TRUE(copy.records().capacity() > copy.size());
+    TEST_ASSERT_TRUE(copy.labels().capacity() >= copy.labels().size() + 100);
+}
+
+void test_credential_card_matches_decimal_code(void) {
+    CredentialIndex index;
+    index.addJson("[{\"code\":\"1193046\",\"label\":\"Card\"}]", CredentialGroup::OWNER);
+    index.finalize();
+    // 26-bit card with facility 0x12 and card number 0x3456 (1193046 == 0x123456)
+    Credential card = Credential::fromValue(0x123456, 26);
+    const char* label = nullptr;
+
+    TEST_ASSERT_EQUAL(0x12, card.facility);
+    TEST_ASSERT_EQUAL(0x3456, card.cardNumber);
+    TEST_ASSERT_EQUAL(static_cast<int>(AccessType::OPEN_MAIL), static_cast<int>(AccessControl::evaluate(card, index, &label)));
+    TEST_ASSERT_EQUAL_STRING("Card", label);
+}
+
+void test_credential_keypad_pin_matches_code(void) {
+    CredentialIndex index;
+    index.addJson("[{\"code\":\"4711\",\"label\":\"Courier\"}]", CredentialGroup::DELIVERY);
+    index.finalize();
+    WiegandDecoder decoder;
+    Credential pin = {};
+    const uint8_t keys[] = { 4, 7, 1, 1, 0x0B };
+    for (uint8_t key : keys) {
+        decoder.decode(key, 4, 0, pin);
+    }
+
+    TEST_ASSERT_EQUAL(4, pin.bits);
+    TEST_ASSERT_EQUAL(static_cast<int>(AccessType::OPEN_PARCEL), static_cast<int>(AccessControl::evaluate(pin, index)));
+}
+
+static Credential typePin(const char* digits) {
+    WiegandDecoder decoder;
+    Credential pin = {};
+    for (const char* p = digits; *p; ++p) {
+        decoder.decode(*p - '0', 4, 0, pin);
+    }
+    decoder.decode(0x0B, 4, 0, pin);
+    return pin;
+}
+
+void test_credential_keypad_pin_keeps_leading_zeros(void) {
+    CredentialIndex index;
+    index.addJson("[{\"code\":\"0815\",\"label\":\"Courier\"},{\"code\":\"0000\",\"label\":\"Zero\"}]", CredentialGroup::DELIVERY);
+    index.finalize();
+    const char* label = nullptr;
+
+    TEST_ASSERT_EQUAL(4, typePin("0815").digits);
+    TEST_ASSERT_EQUAL(static_cast<int>(AccessType::OPEN_PARCEL), static_cast<int>(AccessControl::evaluate(typePin("0815"), index, &label)));
+    TEST_ASSERT_EQUAL_STRING("Courier", label);
+    TEST_ASSERT_EQUAL(static_cast<int>(AccessType::DENIED), static_cast<int>(AccessControl::evaluate(typePin("815"), index)));
+    TEST_ASSERT_EQUAL(static_cast<int>(AccessType::DENIED), static_cast<int>(AccessControl::evaluate(typePin("00815"), index)));
+    TEST_ASSERT_EQUAL(static_cast<int>(AccessType::OPEN_PARCEL), static_cast<int>(AccessControl::evaluate(typePin("0000"), index)));
+    TEST_ASSERT_EQUAL(static_cast<int>(AccessType::DENIED), static_cast<int>(AccessControl::evaluate(typePin("0"), index)));
+    TEST_ASSERT_EQUAL(static_cast<int>(AccessType::DENIED), static_cast<int>(AccessControl::evaluate(Credential::fromValue(0x815, 26), index)));
+
+    // Listed again as written
+    char code[24];
+    index.codeText(*index.findScanned("0815"), code, sizeof(code));
+    TEST_ASSERT_EQUAL_STRING("0815", code);
+    TEST_ASSERT_NULL(index.findScanned("815"));
+}
+
 int main(int argc, char **argv) {
     UNITY_BEGIN();
     RUN_TEST(test_access_denied_empty_json);
@@ -89,6 +244,14 @@ int main(int argc, char **argv) {
     RUN_TEST(test_access_handles_missing_label);
     RUN_TEST(test_access_decimal_stored_matches_scanned_hex);
     RUN_TEST(test_access_hex_stored_matches_scanned_hex);
+    RUN_TEST(test_index_owner_wins_over_delivery);
+    RUN_TEST(test_index_interns_labels);
+    RUN_TEST(test_index_large_list_lookup);
+    RUN_TEST(test_index_live_edits_keep_order);
+    RUN_TEST(test_index_compacted_copy_drops_replaced_labels);
+    RUN_TEST(test_credential_card_matches_decimal_code);
+    RUN_TEST(test_credential_keypad_pin_matches_code);
+    RUN_TEST(test_credential_keypad_pin_keeps_leading_zeros);
     UNITY_END();
     return 0;
 }
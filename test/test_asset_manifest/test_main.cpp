@@ -0,0 +1,46 @@
+#include <unity.h>
+#include "AssetManifest.h"
+#include <string>
+
+void setUp(void) {
+    // set stuff up here
+}
+
+void tearDown(void) {
+    // clean stuff up here
+}
+
+void test_asset_manifest_parses_entries(void) {
+    AssetManifest manifest;
+    size_t count = manifest.parse("/index.html 0123456789abcdef 1 text/html\r\n"
+                                  "broken line\n"
+                                  "/logo.png fedcba9876543210 0 image/png\n");
+
+    TEST_ASSERT_EQUAL(2, count);
+    const Asset* index = manifest.find("/index.html");
+    TEST_ASSERT_NOT_NULL(index);
+    TEST_ASSERT_EQUAL_STRING("\"0123456789abcdef\"", index->etag.c_str());
+    TEST_ASSERT_EQUAL_STRING("text/html", index->contentType.c_str());
+    TEST_ASSERT_TRUE(index->gzipped);
+    TEST_ASSERT_FALSE(manifest.find("/logo.png")->gzipped);
+    TEST_ASSERT_NULL(manifest.find("/missing.html"));
+}
+
+void test_asset_etag_matching(void) {
+    std::string etag = "\"0123456789abcdef\"";
+
+    TEST_ASSERT_TRUE(AssetManifest::etagMatches("\"0123456789abcdef\"", etag));
+    TEST_ASSERT_TRUE(AssetManifest::etagMatches("\"old\", W/\"0123456789abcdef\"", etag));
+    TEST_ASSERT_TRUE(AssetManifest::etagMatches("*", etag));
+    TEST_ASSERT_FALSE(AssetManifest::etagMatches("\"0123456789abcde\"", etag));
+    TEST_ASSERT_FALSE(AssetManifest::etagMatches("", etag));
+    TEST_ASSERT_FALSE(AssetManifest::etagMatches(nullptr, etag));
+}
+
+int main(int argc, char **argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_asset_manifest_parses_entries);
+    RUN_TEST(test_asset_etag_matching);
+    UNITY_END();
+    return 0;
+}
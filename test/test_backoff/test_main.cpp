@@ -0,0 +1,45 @@
+#include <unity.h>
+#include "Backoff.h"
+
+void setUp(void) {
+    // set stuff up here
+}
+
+void tearDown(void) {
+    // clean stuff up here
+}
+
+void test_backoff_doubles_up_to_max(void) {
+    Backoff backoff(1000, 8000, 0);
+
+    TEST_ASSERT_EQUAL_UINT32(1000, backoff.next(0));
+    TEST_ASSERT_EQUAL_UINT32(2000, backoff.next(0));
+    TEST_ASSERT_EQUAL_UINT32(4000, backoff.next(0));
+    TEST_ASSERT_EQUAL_UINT32(8000, backoff.next(0));
+    TEST_ASSERT_EQUAL_UINT32(8000, backoff.next(0));
+    for (int i = 0; i < 100; ++i) {
+        backoff.next(0);
+    }
+    TEST_ASSERT_EQUAL_UINT32(8000, backoff.next(0));
+    backoff.reset();
+    TEST_ASSERT_EQUAL_UINT32(1000, backoff.next(0));
+}
+
+void test_backoff_jitter_stays_in_range(void) {
+    Backoff backoff(1000, 60000, 20);
+
+    TEST_ASSERT_EQUAL_UINT32(800, backoff.next(0));
+    backoff.reset();
+    TEST_ASSERT_EQUAL_UINT32(1200, backoff.next(400));
+    backoff.reset();
+    TEST_ASSERT_EQUAL_UINT32(800, backoff.next(401));
+    TEST_ASSERT_EQUAL(1, backoff.failures());
+}
+
+int main(int argc, char **argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_backoff_doubles_up_to_max);
+    RUN_TEST(test_backoff_jitter_stays_in_range);
+    UNITY_END();
+    return 0;
+}
@@ -0,0 +1,179 @@
+#ifndef LOOPBACK_BROKER_H
+#define LOOPBACK_BROKER_H
+
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <string>
+#include <vector>
+#include "MqttSession.h"
+
+// In-process stand-in for the broker: keeps what the box published and hands
+// it the commands a client sends. Time is virtual (now), so connect delays
+// and backoff run without sleeping. Faults are injected by clearing
+// available (refuses connects and publishes) or calling dropConnections().
+// Every message is counted; with record cleared only the last one is kept,
+// so a benchmark loop does not measure the broker's own allocations.
+struct LoopbackBroker {
+    struct Published {
+        std::string topic;
+        std::string payload;
+        uint32_t at;
+    };
+    static const size_t MAX_PENDING = 8;
+
+    uint32_t now = 0;
+    bool networkUp = true;
+    bool available = true;
+    uint32_t connectDelayMs = 0;
+    bool record = true;
+
+    std::vector<Published> published;
+    Published last;
+    uint32_t delivered = 0;
+    uint32_t attempts = 0;
+    uint32_t generation = 0;   // bumped by dropConnections()
+
+    // Returns false if MAX_PENDING commands are already waiting
+    bool sendCommand(const char* payload, size_t length) {
+        if (_pendingCount == MAX_PENDING) {
+            return false;
+        }
+        _pending[(_pendingHead + _pendingCount++) % MAX_PENDING].assign(payload, length);
+        return true;
+    }
+    bool sendCommand(const char* payload) { return sendCommand(payload, strlen(payload)); }
+    bool nextCommand(std::string& out) {
+        if (_pendingCount == 0) {
+            return false;
+        }
+        out.swap(_pending[_pendingHead]);
+        _pendingHead = (_pendingHead + 1) % MAX_PENDING;
+        _pendingCount--;
+        return true;
+    }
+    void dropConnections() { generation++; }
+
+    void receive(const char* topic, const uint8_t* payload, size_t length) {
+        last.topic.assign(topic);
+        last.payload.assign(reinterpret_cast<const char*>(payload), length);
+        last.at = now;
+        delivered++;
+        if (record) {
+            published.push_back(last);
+        }
+    }
+
+    size_t count(const char* topic) const {
+        size_t n = 0;
+        for (const Published& message : published) {
+            n += message.topic == topic;
+        }
+        return n;
+    }
+
+private:
+    std::string _pending[MAX_PENDING];
+    size_t _pendingHead = 0;
+    size_t _pendingCount = 0;
+};
+
+// The box's side of a LoopbackBroker connection, in place of PubSubClient and
+// the connect task. loop() delivers the pending commands to onCommand.
+class LoopbackLink : public MqttLink {
+public:
+    explicit LoopbackLink(LoopbackBroker& broker) : _broker(broker) {}
+
+    std::function<void(char* payload, size_t length)> onCommand;
+    uint32_t connectedEvents = 0;
+    uint32_t lostEvents = 0;
+
+    bool networkUp() override { return _broker.networkUp; }
+
+    void beginConnect() override {
+        _broker.attempts++;
+        _startedAt = _broker.now;
+    }
+
+    int connectResult() override {
+        if (_broker.now - _startedAt < _broker.connectDelayMs) {
+            return 0;
+        }
+        return _broker.available ? 1 : -1;
+    }
+
+    bool handshake() override {
+        _connected = _broker.available;
+        _generation = _broker.generation;
+        return _connected;
+    }
+
+    bool loop() override {
+        if (!_connected || _generation != _broker.generation) {
+            _connected = false;
+            return false;
+        }
+        // PubSubClient hands the callback its own buffer, which the parser may rewrite
+        while (_broker.nextCommand(_buffer)) {
+            if (onCommand) {
+                onCommand(&_buffer[0], _buffer.size());
+            }
+        }
+        return true;
+    }
+
+    bool publish(const char* topic, const uint8_t* payload, size_t length) override {
+        if (!_connected || !_broker.available || _generation != _broker.generation) {
+            return false;
+        }
+        _broker.receive(topic, payload, length);
+        return true;
+    }
+
+    void close() override { _connected = false; }
+    void onConnected(uint32_t connectMs) override { (void)connectMs; connectedEvents++; }
+    void onConnectionLost() override { lostEvents++; }
+
+private:
+    LoopbackBroker& _broker;
+    bool _connected = false;
+    uint32_t _generation = 0;
+    uint32_t _startedAt = 0;
+    std::string _buffer;
+};
+
+// RAM spool in place of the EventJournal
+class MemorySpool : public MqttSpool {
+public:
+    size_t limit = 64;
+
+    bool append(uint8_t kind, const char* data, size_t length) override {
+        if (_messages.size() >= limit) {
+            return false;
+        }
+        MqttOutbox::Message message;
+        message.kind = kind;
+        message.length = static_cast<uint16_t>(length);
+        memcpy(message.data, data, length);
+        _messages.push_back(message);
+        return true;
+    }
+
+    bool peek(MqttOutbox::Message& out) override {
+        if (_messages.empty()) {
+            return false;
+        }
+        out = _messages.front();
+        return true;
+    }
+
+    void consume() override { _messages.pop_front(); }
+    bool empty() const override { return _messages.empty(); }
+    size_t size() const { return _messages.size(); }
+
+private:
+    std::deque<MqttOutbox::Message> _messages;
+};
+
+#endif
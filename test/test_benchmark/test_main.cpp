@@ -0,0 +1,415 @@
+// Hot-path benchmarks for the native env. Run with:
+//   pio test -e native_bench
+// Results are printed and written as JSON to $BENCH_OUTPUT (default bench_results.json).
+
+#include <unity.h>
+#include "AccessControl.h"
+#include "CredentialIndex.h"
+#include "OneTimeCodeStore.h"
+#include "WiegandDecoder.h"
+#include "MqttCommand.h"
+#include "MqttSession.h"
+#include "LoopbackBroker.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#if defined(__GLIBC__)
+#include <malloc.h>
+
+// Count allocations by interposing the C allocator; operator new and
+// ArduinoJson's default allocator both end up here.
+extern "C" void* __libc_malloc(size_t size);
+extern "C" void* __libc_calloc(size_t count, size_t size);
+extern "C" void* __libc_realloc(void* ptr, size_t size);
+extern "C" void __libc_free(void* ptr);
+
+static size_t allocCount = 0;
+static long liveBytes = 0;
+static long peakBytes = 0;
+
+static void trackAlloc(void* ptr) {
+    if (ptr) {
+        allocCount++;
+        liveBytes += malloc_usable_size(ptr);
+        if (liveBytes > peakBytes) peakBytes = liveBytes;
+    }
+}
+
+static void trackFree(void* ptr) {
+    if (ptr) {
+        liveBytes -= malloc_usable_size(ptr);
+    }
+}
+
+extern "C" void* malloc(size_t size) {
+    void* ptr = __libc_malloc(size);
+    trackAlloc(ptr);
+    return ptr;
+}
+
+extern "C" void* calloc(size_t count, size_t size) {
+    void* ptr = __libc_calloc(count, size);
+    trackAlloc(ptr);
+    return ptr;
+}
+
+extern "C" void* realloc(void* ptr, size_t size) {
+    trackFree(ptr);
+    void* result = __libc_realloc(ptr, size);
+    if (result) {
+        trackAlloc(result);
+    } else if (ptr && size) {
+        liveBytes += malloc_usable_size(ptr); // original block is still owned by the caller
+    }
+    return result;
+}
+
+extern "C" void free(void* ptr) {
+    trackFree(ptr);
+    __libc_free(ptr);
+}
+
+#define ALLOCATIONS_TRACKED 1
+#else
+static size_t allocCount = 0;
+static long liveBytes = 0;
+static long peakBytes = 0;
+#define ALLOCATIONS_TRACKED 0
+#endif
+
+static const int LIST_SIZES[] = { 10, 100, 1000, 10000 };
+static std::string results;
+
+struct BenchStats {
+    double nsPerOp;
+    double allocsPerOp;
+    long peakHeap;
+};
+
+template <typename Fn>
+static BenchStats measure(int iterations, Fn&& fn) {
+    fn(); // warm-up, also keeps one-off lazy allocations out of the numbers
+
+    size_t allocsBefore = allocCount;
+    long baseline = liveBytes;
+    peakBytes = liveBytes;
+
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; i++) {
+        fn();
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+
+    BenchStats stats;
+    stats.nsPerOp = std::chrono::duration<double, std::nano>(elapsed).count() / iterations;
+    stats.allocsPerOp = ALLOCATIONS_TRACKED ? double(allocCount - allocsBefore) / iterations : -1;
+    stats.peakHeap = ALLOCATIONS_TRACKED ? peakBytes - baseline : -1;
+    return stats;
+}
+
+static void report(const char* name, int listSize, const BenchStats& stats) {
+    printf("%-34s n=%-6d %12.1f ns/op %8.2f allocs/op %10ld B peak\n", name, listSize, stats.nsPerOp, stats.allocsPerOp, stats.peakHeap);
+
+    char line[256];
+    snprintf(line, sizeof(line), "%s{\"name\":\"%s\",\"n\":%d,\"ns_per_op\":%.1f,\"allocs_per_op\":%.2f,\"peak_heap_bytes\":%ld}",
+             results.empty() ? "" : ",\n  ", name, listSize, stats.nsPerOp, stats.allocsPerOp, stats.peakHeap);
+    results += line;
+}
+
+// Single figure that is not a timing, e.g. a count from a simulation run
+static void note(const char* name, int n, const char* metric, double value) {
+    printf("%-34s n=%-6d %12.1f %s\n", name, n, value, metric);
+
+    char line[256];
+    snprintf(line, sizeof(line), "%s{\"name\":\"%s\",\"n\":%d,\"%s\":%.1f}",
+             results.empty() ? "" : ",\n  ", name, n, metric, value);
+    results += line;
+}
+
+static int iterationsFor(int listSize) {
+    return listSize >= 10000 ? 50 : listSize >= 1000 ? 500 : 5000;
+}
+
+// Codes are decimal like the ones typed into the web UI; the scan arrives as hex.
+static std::string buildCodesJson(int count, int base, const char* label, bool oneTime) {
+    std::string json = "[";
+    char entry[96];
+    for (int i = 0; i < count; i++) {
+        snprintf(entry, sizeof(entry), "%s{\"code\":\"%d\",\"label\":\"%s\"%s}",
+                 i ? "," : "", base + i, label, oneTime ? ",\"redeemed\":false" : "");
+        json += entry;
+    }
+    json += "]";
+    return json;
+}
+
+static Credential cardOf(int value) {
+    return Credential::fromValue(value, 26);
+}
+
+void setUp(void) {}
+
+void tearDown(void) {}
+
+void bench_access_evaluate(void) {
+    for (int n : LIST_SIZES) {
+        std::string owner = buildCodesJson(n / 2 + 1, 100000, "Owner", false);
+        std::string delivery = buildCodesJson(n / 2 + 1, 500000, "Courier", false);
+        CredentialIndex index;
+        index.addJson(owner.c_str(), CredentialGroup::OWNER);
+        index.addJson(delivery.c_str(), CredentialGroup::DELIVERY);
+        index.finalize();
+
+        Credential hit = cardOf(500000 + n / 2);
+        Credential miss = cardOf(900000);
+
+        const char* label = nullptr;
+        volatile int sink = 0;
+        report("access_evaluate_hit", n, measure(iterationsFor(n), [&]() {
+            sink += static_cast<int>(AccessControl::evaluate(hit, index, &label));
+        }));
+        report("access_evaluate_miss", n, measure(iterationsFor(n), [&]() {
+            sink += static_cast<int>(AccessControl::evaluate(miss, index, &label));
+        }));
+        TEST_ASSERT_EQUAL(static_cast<int>(AccessType::OPEN_PARCEL), static_cast<int>(AccessControl::evaluate(hit, index)));
+    }
+}
+
+void bench_one_time_code_redeem(void) {
+    for (int n : LIST_SIZES) {
+        std::string codes = buildCodesJson(n, 700000, "Parcel", true);
+        OneTimeCodeStore store;
+        store.load(codes.c_str(), 1);
+
+        Credential miss = cardOf(900000);
+        const char* label = nullptr;
+        RedemptionRecord record;
+        volatile int sink = 0;
+        report("one_time_code_miss", n, measure(iterationsFor(n), [&]() {
+            sink += static_cast<int>(store.redeem(miss, false, 0, &label, &record));
+        }));
+
+        // Every op redeems a different code, walking down from the end of the list
+        int iterations = n - 1 < iterationsFor(n) ? n - 1 : iterationsFor(n);
+        int next = n - 1;
+        Credential hit;
+        report("one_time_code_redeem", n, measure(iterations, [&]() {
+            hit = cardOf(700000 + next--);
+            sink += static_cast<int>(store.redeem(hit, false, 0, &label, &record));
+        }));
+        TEST_ASSERT_EQUAL(static_cast<int>(RedeemResult::ALREADY_REDEEMED),
+                          static_cast<int>(store.redeem(hit, false, 0, &label, &record)));
+        TEST_ASSERT_EQUAL(n - 1 - iterations, next + 1);
+    }
+}
+
+void bench_wiegand_decode(void) {
+    WiegandDecoder decoder;
+    Credential credential;
+    volatile int sink = 0;
+    // 26-bit frame with parity bits around facility 0x12 / card 0x3456
+    const uint64_t frame26 = (0x123456ULL << 1) | 1;
+    report("wiegand_decode_26bit", 1, measure(100000, [&]() {
+        sink += static_cast<int>(decoder.decode(frame26, 26, 0, credential));
+    }));
+    TEST_ASSERT_EQUAL(0x123456, credential.value());
+
+    // Six keypad digits followed by '#' (4-bit keypad mode)
+    report("wiegand_decode_keypad_pin", 7, measure(20000, [&]() {
+        for (uint8_t key = 1; key <= 6; key++) {
+            decoder.decode(key, 4, 0, credential);
+        }
+        sink += static_cast<int>(decoder.decode(0x0B, 4, 0, credential));
+    }));
+    TEST_ASSERT_EQUAL(0x123456, credential.value());
+}
+
+// The box as the MQTT task sees it, against an in-process broker: commands
+// come in through the link, the handler answers and queues a state message
+// the way main.cpp does, and the session publishes both in the same update.
+struct SimulatedBox {
+    MqttOutbox outbox;
+    LoopbackBroker broker;
+    LoopbackLink link;
+    MemorySpool spool;
+    MqttSession session;
+    uint32_t opened = 0;
+    uint32_t seed = 1;
+
+    SimulatedBox() :
+        outbox(OverflowPolicy::DROP_OLDEST),
+        link(broker),
+        session(outbox, link, &spool)
+    {
+        link.onCommand = [this](char* payload, size_t length) { handle(payload, length); };
+        session.reset(true, 0);
+    }
+
+    void handle(char* payload, size_t length) {
+        MqttCommand command;
+        const char* error = parseMqttCommand(payload, length, command);
+        if (error == nullptr && command.action == MqttCommandAction::OPEN) {
+            opened++;
+            pushState(command.compartment.equals("parcel") ? "OPENING_PARCEL" : "OPENING_MAIL");
+        }
+        char response[MqttOutbox::Message::CAPACITY];
+        size_t responseLength = formatMqttResponse(response, sizeof(response), command, error, "LOCKED");
+        if (responseLength > 0) {
+            outbox.push(MQTT_TOPIC_RESPONSE, response, responseLength);
+        }
+    }
+
+    void pushState(const char* state) {
+        char output[MqttOutbox::Message::CAPACITY];
+        int length = snprintf(output, sizeof(output), "{\"v\":%u,\"state\":\"%s\",\"last_used\":\"mqtt\",\"time\":%lu}",
+                              (unsigned)MQTT_SCHEMA_VERSION, state, (unsigned long)broker.now);
+        outbox.push(MQTT_TOPIC_STATE, output, length);
+    }
+
+    // One pass of mqttTask; deterministic jitter so runs compare
+    void tick(uint32_t ms) {
+        broker.now += ms;
+        seed = seed * 1103515245 + 12345;
+        session.update(broker.now, seed >> 8);
+    }
+
+    // Ticks every stepMs (the task's notification timeout) until connected
+    uint32_t connect(uint32_t stepMs, uint32_t limitMs) {
+        uint32_t startedAt = broker.now;
+        while (session.state() != MqttState::CONNECTED && broker.now - startedAt < limitMs) {
+            tick(stepMs);
+        }
+        return broker.now - startedAt;
+    }
+};
+
+void bench_mqtt_command_to_state(void) {
+    SimulatedBox box;
+    box.broker.record = false;
+    box.connect(50, 1000);
+    TEST_ASSERT_EQUAL(static_cast<int>(MqttState::CONNECTED), static_cast<int>(box.session.state()));
+
+    // Command in, state and response out, all within one update
+    const char json[] = "{\"cmd\":\"open\",\"compartment\":\"parcel\",\"id\":\"42\"}";
+    report("mqtt_command_to_state_json", 1, measure(20000, [&]() {
+        box.broker.sendCommand(json, sizeof(json) - 1);
+        box.tick(0);
+    }));
+    TEST_ASSERT_EQUAL_STRING("paketkasten/response", box.broker.last.topic.c_str());
+
+    const char packed[] = "\x83\xA3" "cmd" "\xA4" "open" "\xAB" "compartment" "\xA4" "mail" "\xA2" "id" "\xA2" "42";
+    report("mqtt_command_to_state_msgpack", 1, measure(20000, [&]() {
+        box.broker.sendCommand(packed, sizeof(packed) - 1);
+        box.tick(0);
+    }));
+    TEST_ASSERT_EQUAL(2 * 20001, box.opened);
+    TEST_ASSERT_EQUAL(4 * 20001, box.broker.delivered);
+    TEST_ASSERT_EQUAL(0, box.outbox.dropped());
+}
+
+void bench_mqtt_burst_throughput(void) {
+    // More state changes between two passes of the task than the outbox holds:
+    // the oldest are dropped, the latest always gets out
+    const int BURSTS[] = { 4, 16, 64 };
+    for (int burst : BURSTS) {
+        SimulatedBox box;
+        box.broker.record = false;
+        box.connect(50, 1000);
+        report("mqtt_burst_connected", burst, measure(2000, [&]() {
+            for (int i = 0; i < burst; i++) {
+                box.pushState(i & 1 ? "LOCKED" : "OPENING_PARCEL");
+            }
+            box.tick(1);
+        }));
+        int kept = burst < static_cast<int>(box.outbox.capacity()) ? burst : static_cast<int>(box.outbox.capacity());
+        TEST_ASSERT_EQUAL(kept * 2001, box.broker.delivered);
+        note("mqtt_burst_dropped_per_update", burst, "messages", double(box.outbox.dropped()) / 2001);
+    }
+
+    // A burst during an outage goes to the spool and is replayed in order,
+    // REPLAY_BATCH per REPLAY_INTERVAL_MS
+    SimulatedBox box;
+    box.connect(50, 1000);
+    box.broker.available = false;
+    box.broker.dropConnections();
+    for (int i = 0; i < 60; i++) {
+        box.pushState(i & 1 ? "LOCKED" : "OPENING_MAIL");
+        box.tick(10);
+    }
+    TEST_ASSERT_EQUAL(60, box.spool.size());
+    box.broker.available = true;
+    uint32_t outageEnd = box.broker.now;
+    box.connect(50, 600000);
+    while (!box.spool.empty()) {
+        box.tick(10);
+    }
+    note("mqtt_spool_replay_60", 60, "ms_to_drain", box.broker.now - outageEnd);
+    TEST_ASSERT_EQUAL(60, box.broker.count("paketkasten/state"));
+    TEST_ASSERT_EQUAL(60, box.session.replayed());
+    uint32_t previous = 0;
+    for (const LoopbackBroker::Published& message : box.broker.published) {
+        uint32_t time = strtoul(strstr(message.payload.c_str(), "\"time\":") + 7, nullptr, 10);
+        TEST_ASSERT_TRUE(time >= previous);
+        previous = time;
+    }
+}
+
+void bench_mqtt_reconnect(void) {
+    // Broker gone for a while, 150 ms transport handshake, task passes every 50 ms
+    const int OUTAGES_S[] = { 10, 60, 600, 3600 };
+    for (int outage : OUTAGES_S) {
+        SimulatedBox box;
+        box.broker.connectDelayMs = 150;
+        box.connect(50, 10000);
+        TEST_ASSERT_EQUAL(static_cast<int>(MqttState::CONNECTED), static_cast<int>(box.session.state()));
+
+        box.broker.available = false;
+        box.broker.dropConnections();
+        uint32_t attemptsBefore = box.broker.attempts;
+        uint32_t outageEnd = box.broker.now + outage * 1000u;
+        while (box.broker.now < outageEnd) {
+            box.tick(50);
+        }
+        box.broker.available = true;
+        uint32_t toReconnect = box.connect(50, 600000);
+
+        TEST_ASSERT_EQUAL(static_cast<int>(MqttState::CONNECTED), static_cast<int>(box.session.state()));
+        TEST_ASSERT_EQUAL(2, box.link.connectedEvents);
+        TEST_ASSERT_EQUAL(1, box.link.lostEvents);
+        // The backoff caps the wait at its maximum plus jitter and the handshake
+        TEST_ASSERT_TRUE(toReconnect <= 360000 + 250);
+        note("mqtt_reconnect_attempts", outage, "attempts", box.broker.attempts - attemptsBefore);
+        note("mqtt_reconnect_after_outage", outage, "ms_to_connect", toReconnect);
+    }
+}
+
+static void writeResults() {
+    const char* path = getenv("BENCH_OUTPUT");
+    if (!path || !*path) {
+        path = "bench_results.json";
+    }
+    FILE* file = fopen(path, "w");
+    if (!file) {
+        printf("Could not write benchmark results to %s\n", path);
+        return;
+    }
+    fprintf(file, "{\"allocations_tracked\":%s,\"results\":[\n  %s\n]}\n", ALLOCATIONS_TRACKED ? "true" : "false", results.c_str());
+    fclose(file);
+    printf("Benchmark results written to %s\n", path);
+}
+
+int main(int argc, char **argv) {
+    UNITY_BEGIN();
+    RUN_TEST(bench_access_evaluate);
+    RUN_TEST(bench_one_time_code_redeem);
+    RUN_TEST(bench_wiegand_decode);
+    RUN_TEST(bench_mqtt_command_to_state);
+    RUN_TEST(bench_mqtt_burst_throughput);
+    RUN_TEST(bench_mqtt_reconnect);
+    writeResults();
+    UNITY_END();
+    return 0;
+}
@@ -0,0 +1,292 @@
+#include <unity.h>
+#include "CredentialStore.h"
+#include "OneTimeCodeStore.h"
+#include <cstring>
+#include <map>
+#include <string>
+
+// Files kept in RAM, opened with the same modes as on LittleFS
+class MemoryFile : public StorageFile {
+public:
+    MemoryFile(std::string& data, bool append) : _data(data), _position(append ? data.size() : 0) {}
+    size_t read(void* data, size_t length) override {
+        size_t n = _position < _data.size() ? std::min(length, _data.size() - _position) : 0;
+        memcpy(data, _data.data() + _position, n);
+        _position += n;
+        return n;
+    }
+    size_t write(const void* data, size_t length) override {
+        if (_position + length > _data.size()) {
+            _data.resize(_position + length);
+        }
+        memcpy(&_data[_position], data, length);
+        _position += length;
+        return length;
+    }
+    bool seek(size_t position) override {
+        _position = position;
+        return position <= _data.size();
+    }
+    size_t size() override { return _data.size(); }
+
+private:
+    std::string& _data;
+    size_t _position;
+};
+
+class MemoryStorage : public Storage {
+public:
+    std::unique_ptr<StorageFile> open(const char* path, const char* mode) override {
+        if (mode[0] == 'r' && !exists(path)) {
+            return nullptr;
+        }
+        std::string& data = files[path];
+        if (mode[0] == 'w') {
+            data.clear();
+        }
+        return std::unique_ptr<StorageFile>(new MemoryFile(data, mode[0] == 'a'));
+    }
+    bool exists(const char* path) override { return files.count(path) != 0; }
+    bool remove(const char* path) override { return files.erase(path) != 0; }
+    bool rename(const char* from, const char* to) override {
+        if (!exists(from)) {
+            return false;
+        }
+        files[to] = files[from];
+        files.erase(from);
+        return true;
+    }
+
+    std::map<std::string, std::string> files;
+};
+
+static const char* const PATH = "/credentials.bin";
+static const char* const JOURNAL_PATH = "/credentials.log";
+
+static Credential typed(const char* code) {
+    return Credential::fromValue(strtoull(code, nullptr, 16), 4, strlen(code));
+}
+
+void setUp(void) {
+    // set stuff up here
+}
+
+void tearDown(void) {
+    // clean stuff up here
+}
+
+void test_credential_store_round_trip(void) {
+    MemoryStorage storage;
+    CredentialIndex access;
+    access.addJson("[{\"code\":\"4711\",\"label\":\"Anna\"}]", CredentialGroup::OWNER);
+    access.addJson("[{\"code\":\"0815\",\"label\":\"DHL\"}]", CredentialGroup::DELIVERY);
+    access.finalize();
+    OneTimeCodeStore oneTime;
+    oneTime.load("[{\"code\":\"1111\",\"label\":\"Parcel\"}]", 7);
+    TEST_ASSERT_TRUE(CredentialStore::save(storage, PATH, access, oneTime.codes(), oneTime.listId()));
+    TEST_ASSERT_FALSE(storage.exists("/credentials.bin.tmp"));
+
+    CredentialIndex loadedAccess;
+    CredentialIndex loadedOneTime;
+    uint32_t listId = 0;
+    TEST_ASSERT_EQUAL(static_cast<int>(CredentialFileStatus::OK),
+                      static_cast<int>(CredentialStore::load(storage, PATH, loadedAccess, loadedOneTime, listId)));
+    TEST_ASSERT_EQUAL(7, listId);
+    TEST_ASSERT_EQUAL(2, loadedAccess.size());
+    TEST_ASSERT_EQUAL_STRING("DHL", loadedAccess.label(*loadedAccess.findScanned("0815")));
+    TEST_ASSERT_EQUAL_STRING("Parcel", loadedOneTime.label(*loadedOneTime.findScanned("1111")));
+
+    // One flipped byte is caught by the CRC
+    storage.files[PATH][sizeof(CredentialFileHeader)] ^= 1;
+    TEST_ASSERT_EQUAL(static_cast<int>(CredentialFileStatus::CORRUPT),
+                      static_cast<int>(CredentialStore::load(storage, PATH, loadedAccess, loadedOneTime, listId)));
+}
+
+// Redemptions are folded into the file while API edits are still only in the
+// journal. The in-place update must leave the file's access section as it is.
+void test_credential_store_fold_with_pending_journal(void) {
+    MemoryStorage storage;
+    CredentialIndex access;
+    access.addJson("[{\"code\":\"4711\",\"label\":\"Anna\"},{\"code\":\"4712\",\"label\":\"Ben\"}]", CredentialGroup::OWNER);
+    access.finalize();
+    OneTimeCodeStore oneTime;
+    oneTime.load("[{\"code\":\"1111\",\"label\":\"Parcel\"},{\"code\":\"2222\"},{\"code\":\"3333\"}]", 7);
+    TEST_ASSERT_TRUE(CredentialStore::save(storage, PATH, access, oneTime.codes(), oneTime.listId()));
+
+    // What the API does: edit the index in RAM, append to the journal, leave the file alone
+    char code[8];
+    for (int i = 0; i < 40; i++) {
+        snprintf(code, sizeof(code), "%d", 9000 + i);
+        TEST_ASSERT_TRUE(CredentialStore::applyChange(access, CredentialStore::CHANGE_UPSERT, CredentialGroup::DELIVERY, code, "Courier"));
+        TEST_ASSERT_TRUE(CredentialStore::appendChange(storage, JOURNAL_PATH, CredentialStore::CHANGE_UPSERT, CredentialGroup::DELIVERY, code, "Courier"));
+    }
+    TEST_ASSERT_TRUE(CredentialStore::applyChange(access, CredentialStore::CHANGE_ERASE, CredentialGroup::OWNER, "4712", nullptr));
+    TEST_ASSERT_TRUE(CredentialStore::appendChange(storage, JOURNAL_PATH, CredentialStore::CHANGE_ERASE, CredentialGroup::OWNER, "4712", nullptr));
+
+    TEST_ASSERT_EQUAL(static_cast<int>(RedeemResult::REDEEMED),
+                      static_cast<int>(oneTime.redeem(typed("2222"), false, 1000, nullptr, nullptr)));
+    std::vector<size_t> changed = oneTime.foldRedemptions();
+    TEST_ASSERT_EQUAL(1, changed.size());
+    TEST_ASSERT_TRUE(CredentialStore::updateOneTimeRecords(storage, PATH, oneTime.codes(), oneTime.listId(), changed));
+
+    CredentialIndex loadedAccess;
+    CredentialIndex loadedOneTime;
+    uint32_t listId = 0;
+    TEST_ASSERT_EQUAL(static_cast<int>(CredentialFileStatus::OK),
+                      static_cast<int>(CredentialStore::load(storage, PATH, loadedAccess, loadedOneTime, listId)));
+    TEST_ASSERT_EQUAL(2, loadedAccess.size());
+    TEST_ASSERT_EQUAL(41, CredentialStore::replayChanges(storage, JOURNAL_PATH, loadedAccess));
+    TEST_ASSERT_EQUAL(access.size(), loadedAccess.size());
+    TEST_ASSERT_NULL(loadedAccess.findScanned("4712"));
+    TEST_ASSERT_EQUAL_STRING("Courier", loadedAccess.label(*loadedAccess.findScanned("9039")));
+
+    OneTimeCodeStore reloaded;
+    reloaded.assign(std::move(loadedOneTime), listId);
+    TEST_ASSERT_EQUAL(static_cast<int>(RedeemResult::ALREADY_REDEEMED),
+                      static_cast<int>(reloaded.redeem(typed("2222"), false, 2000, nullptr, nullptr)));
+    TEST_ASSERT_EQUAL(static_cast<int>(RedeemResult::REDEEMED),
+                      static_cast<int>(reloaded.redeem(typed("1111"), false, 2000, nullptr, nullptr)));
+}
+
+void test_credential_store_update_rejects_other_list(void) {
+    MemoryStorage storage;
+    CredentialIndex access;
+    OneTimeCodeStore oneTime;
+    oneTime.load("[{\"code\":\"1111\"},{\"code\":\"2222\"}]", 7);
+    TEST_ASSERT_TRUE(CredentialStore::save(storage, PATH, access, oneTime.codes(), oneTime.listId()));
+    std::string before = storage.files[PATH];
+
+    OneTimeCodeStore replaced;
+    replaced.load("[{\"code\":\"3333\"},{\"code\":\"4444\"}]", 8);
+    replaced.redeem(typed("3333"), false, 1000, nullptr, nullptr);
+    std::vector<size_t> changed = replaced.foldRedemptions();
+    TEST_ASSERT_FALSE(CredentialStore::updateOneTimeRecords(storage, PATH, replaced.codes(), replaced.listId(), changed));
+    TEST_ASSERT_TRUE(before == storage.files[PATH]);
+}
+
+static const char* const LOG_PATH = "/otc_redeemed.log";
+
+// What a boot does: load the file, then apply the redemption log on top of it
+static void reboot(MemoryStorage& storage, OneTimeCodeStore& oneTime, size_t& replayed) {
+    CredentialIndex access;
+    CredentialIndex codes;
+    uint32_t listId = 0;
+    TEST_ASSERT_EQUAL(static_cast<int>(CredentialFileStatus::OK),
+                      static_cast<int>(CredentialStore::load(storage, PATH, access, codes, listId)));
+    oneTime.assign(std::move(codes), listId);
+    replayed = CredentialStore::replayRedemptions(storage, LOG_PATH, oneTime);
+}
+
+void test_credential_store_redemption_log_replay_and_fold(void) {
+    MemoryStorage storage;
+    CredentialIndex access;
+    OneTimeCodeStore oneTime;
+    oneTime.load("[{\"code\":\"1111\"},{\"code\":\"2222\"},{\"code\":\"3333\"}]", 7);
+    TEST_ASSERT_TRUE(CredentialStore::save(storage, PATH, access, oneTime.codes(), oneTime.listId()));
+
+    RedemptionRecord record;
+    TEST_ASSERT_EQUAL(static_cast<int>(RedeemResult::REDEEMED),
+                      static_cast<int>(oneTime.redeem(typed("3333"), false, 1000, nullptr, &record)));
+    TEST_ASSERT_EQUAL(7, record.listId);
+    TEST_ASSERT_TRUE(CredentialStore::appendRedemption(storage, LOG_PATH, record));
+    TEST_ASSERT_EQUAL(static_cast<int>(RedeemResult::REDEEMED),
+                      static_cast<int>(oneTime.redeem(typed("1111"), false, 1100, nullptr, &record)));
+    TEST_ASSERT_TRUE(CredentialStore::appendRedemption(storage, LOG_PATH, record));
+    // Power lost in the middle of a third append
+    storage.files[LOG_PATH].append(reinterpret_cast<const char*>(&record), sizeof(record) - 3);
+
+    // The file alone does not know the redemptions; the log brings them back
+    OneTimeCodeStore reloaded;
+    size_t replayed = 0;
+    reboot(storage, reloaded, replayed);
+    TEST_ASSERT_EQUAL(2, replayed);
+    TEST_ASSERT_EQUAL(static_cast<int>(RedeemResult::ALREADY_REDEEMED),
+                      static_cast<int>(reloaded.redeem(typed("3333"), false, 2000, nullptr, nullptr)));
+    TEST_ASSERT_EQUAL(static_cast<int>(RedeemResult::ALREADY_REDEEMED),
+                      static_cast<int>(reloaded.redeem(typed("1111"), false, 2000, nullptr, nullptr)));
+
+    // Folding writes the flags into the file; the log can then go
+    std::vector<size_t> changed = reloaded.foldRedemptions();
+    TEST_ASSERT_EQUAL(2, changed.size());
+    TEST_ASSERT_TRUE(CredentialStore::updateOneTimeRecords(storage, PATH, reloaded.codes(), reloaded.listId(), changed));
+    TEST_ASSERT_TRUE(reloaded.foldRedemptions().empty());
+    storage.remove(LOG_PATH);
+
+    OneTimeCodeStore folded;
+    reboot(storage, folded, replayed);
+    TEST_ASSERT_EQUAL(0, replayed);
+    TEST_ASSERT_EQUAL(static_cast<int>(RedeemResult::ALREADY_REDEEMED),
+                      static_cast<int>(folded.redeem(typed("3333"), false, 3000, nullptr, nullptr)));
+    TEST_ASSERT_EQUAL(static_cast<int>(RedeemResult::ALREADY_REDEEMED),
+                      static_cast<int>(folded.redeem(typed("1111"), false, 3000, nullptr, nullptr)));
+    TEST_ASSERT_EQUAL(static_cast<int>(RedeemResult::REDEEMED),
+                      static_cast<int>(folded.redeem(typed("2222"), false, 3000, nullptr, nullptr)));
+}
+
+// A log left over from a replaced list must not redeem codes of the new one at the same slots
+void test_credential_store_redemption_of_replaced_list_is_ignored(void) {
+    MemoryStorage storage;
+    CredentialIndex access;
+    OneTimeCodeStore oneTime;
+    oneTime.load("[{\"code\":\"1111\"},{\"code\":\"2222\"}]", 7);
+    TEST_ASSERT_TRUE(CredentialStore::save(storage, PATH, access, oneTime.codes(), oneTime.listId()));
+    RedemptionRecord record;
+    oneTime.redeem(typed("1111"), false, 1000, nullptr, &record);
+    TEST_ASSERT_TRUE(CredentialStore::appendRedemption(storage, LOG_PATH, record));
+
+    // Replaced, and the power lost before the old log was removed
+    OneTimeCodeStore replaced;
+    replaced.load("[{\"code\":\"5555\"},{\"code\":\"6666\"}]", oneTime.listId() + 1);
+    TEST_ASSERT_TRUE(CredentialStore::save(storage, PATH, access, replaced.codes(), replaced.listId()));
+    TEST_ASSERT_FALSE(replaced.apply(record));
+
+    OneTimeCodeStore reloaded;
+    size_t replayed = 0;
+    reboot(storage, reloaded, replayed);
+    TEST_ASSERT_EQUAL(8, reloaded.listId());
+    TEST_ASSERT_EQUAL(0, replayed);
+    TEST_ASSERT_TRUE(reloaded.foldRedemptions().empty());
+    TEST_ASSERT_EQUAL(static_cast<int>(RedeemResult::NOT_FOUND),
+                      static_cast<int>(reloaded.redeem(typed("1111"), false, 2000, nullptr, nullptr)));
+    TEST_ASSERT_EQUAL(static_cast<int>(RedeemResult::REDEEMED),
+                      static_cast<int>(reloaded.redeem(typed("5555"), false, 2000, nullptr, nullptr)));
+}
+
+static CredentialFileStatus loadWithHeader(MemoryStorage& storage, void (*patch)(CredentialFileHeader&)) {
+    CredentialIndex access;
+    access.addJson("[{\"code\":\"4711\",\"label\":\"Anna\"}]", CredentialGroup::OWNER);
+    access.finalize();
+    CredentialIndex oneTime;
+    CredentialStore::save(storage, PATH, access, oneTime, 1);
+    CredentialFileHeader* header = reinterpret_cast<CredentialFileHeader*>(&storage.files[PATH][0]);
+    patch(*header);
+    uint32_t listId = 0;
+    return CredentialStore::load(storage, PATH, access, oneTime, listId);
+}
+
+void test_credential_store_rejects_implausible_header(void) {
+    MemoryStorage storage;
+    TEST_ASSERT_EQUAL(static_cast<int>(CredentialFileStatus::OK),
+                      static_cast<int>(loadWithHeader(storage, [](CredentialFileHeader&) {})));
+    TEST_ASSERT_EQUAL(static_cast<int>(CredentialFileStatus::CORRUPT),
+                      static_cast<int>(loadWithHeader(storage, [](CredentialFileHeader& h) { h.accessCount = 0xFFFFFFFF; })));
+    TEST_ASSERT_EQUAL(static_cast<int>(CredentialFileStatus::CORRUPT),
+                      static_cast<int>(loadWithHeader(storage, [](CredentialFileHeader& h) { h.oneTimeLabelBytes = 0x7FFFFFFF; })));
+    // Counts that would fit the limits but not the file
+    TEST_ASSERT_EQUAL(static_cast<int>(CredentialFileStatus::CORRUPT),
+                      static_cast<int>(loadWithHeader(storage, [](CredentialFileHeader& h) { h.oneTimeCount = 1000; })));
+    TEST_ASSERT_EQUAL(static_cast<int>(CredentialFileStatus::CORRUPT),
+                      static_cast<int>(loadWithHeader(storage, [](CredentialFileHeader& h) { h.accessLabelBytes--; })));
+}
+
+int main(int argc, char **argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_credential_store_round_trip);
+    RUN_TEST(test_credential_store_fold_with_pending_journal);
+    RUN_TEST(test_credential_store_update_rejects_other_list);
+    RUN_TEST(test_credential_store_rejects_implausible_header);
+    RUN_TEST(test_credential_store_redemption_log_replay_and_fold);
+    RUN_TEST(test_credential_store_redemption_of_replaced_list_is_ignored);
+    UNITY_END();
+    return 0;
+}
@@ -0,0 +1,68 @@
+#include <unity.h>
+#include "MessageRing.h"
+#include <string>
+
+void setUp(void) {
+    // set stuff up here
+}
+
+void tearDown(void) {
+    // clean stuff up here
+}
+
+void test_message_ring_keeps_order(void) {
+    MessageRing<4, 16> ring(OverflowPolicy::DROP_NEWEST);
+    MessageRing<4, 16>::Message message;
+    TEST_ASSERT_FALSE(ring.pop(message));
+    TEST_ASSERT_TRUE(ring.push(1, "first", 5));
+    TEST_ASSERT_TRUE(ring.push(2, "second", 6));
+    TEST_ASSERT_EQUAL(2, ring.size());
+
+    TEST_ASSERT_TRUE(ring.pop(message));
+    TEST_ASSERT_EQUAL(1, message.kind);
+    TEST_ASSERT_EQUAL(5, message.length);
+    TEST_ASSERT_EQUAL_MEMORY("first", message.data, 5);
+    TEST_ASSERT_TRUE(ring.pop(message));
+    TEST_ASSERT_EQUAL(2, message.kind);
+    TEST_ASSERT_FALSE(ring.pop(message));
+
+    // Longer than a slot is rejected, not truncated
+    TEST_ASSERT_FALSE(ring.push(1, "0123456789abcdefX", 17));
+    TEST_ASSERT_EQUAL(1, ring.dropped());
+}
+
+void test_message_ring_overflow_policies(void) {
+    char payload[2] = {0, 0};
+    MessageRing<4, 8> newest(OverflowPolicy::DROP_NEWEST);
+    MessageRing<4, 8> oldest(OverflowPolicy::DROP_OLDEST);
+    for (char c = 'a'; c <= 'f'; ++c) {
+        payload[0] = c;
+        newest.push(0, payload, 1);
+        oldest.push(0, payload, 1);
+    }
+    TEST_ASSERT_EQUAL(2, newest.dropped());
+    TEST_ASSERT_EQUAL(2, oldest.dropped());
+    TEST_ASSERT_EQUAL(4, newest.highWater());
+    TEST_ASSERT_EQUAL(4, oldest.highWater());
+
+    MessageRing<4, 8>::Message message;
+    std::string kept;
+    while (newest.pop(message)) {
+        kept += message.data[0];
+    }
+    TEST_ASSERT_EQUAL_STRING("abcd", kept.c_str());
+    kept.clear();
+    while (oldest.pop(message)) {
+        kept += message.data[0];
+    }
+    TEST_ASSERT_EQUAL_STRING("cdef", kept.c_str());
+    TEST_ASSERT_EQUAL(4, oldest.highWater());
+}
+
+int main(int argc, char **argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_message_ring_keeps_order);
+    RUN_TEST(test_message_ring_overflow_policies);
+    UNITY_END();
+    return 0;
+}
@@ -0,0 +1,76 @@
+#include <unity.h>
+#include "MqttCommand.h"
+#include <cstring>
+#include <string>
+
+void setUp(void) {
+    // set stuff up here
+}
+
+void tearDown(void) {
+    // clean stuff up here
+}
+
+void test_mqtt_command_json_in_place(void) {
+    char payload[] = "{\"cmd\":\"add_code\", \"id\":\"r1\", \"group\":\"owner\", \"code\":\"1234\", \"label\":\"K\\u00fcche \\\"A\\\"\", \"ttl\":30}";
+    MqttCommand command;
+    TEST_ASSERT_NULL(parseMqttCommand(payload, strlen(payload), command));
+    TEST_ASSERT_EQUAL(static_cast<int>(MqttCommandAction::ADD_CODE), static_cast<int>(command.action));
+    TEST_ASSERT_EQUAL(static_cast<int>(PayloadFormat::JSON), static_cast<int>(command.format));
+    TEST_ASSERT_TRUE(command.id.equals("r1"));
+    TEST_ASSERT_TRUE(command.code.equals("1234"));
+    TEST_ASSERT_TRUE(command.label.equals("K\xC3\xBC" "che \"A\""));
+    // Views point into the payload buffer
+    TEST_ASSERT_TRUE(command.code.data > payload && command.code.data < payload + sizeof(payload));
+
+    char open[] = "{\"cmd\":\"open\",\"compartment\":\"attic\"}";
+    TEST_ASSERT_NOT_NULL(parseMqttCommand(open, strlen(open), command));
+    char nested[] = "{\"cmd\":\"open\",\"x\":{}}";
+    TEST_ASSERT_NOT_NULL(parseMqttCommand(nested, strlen(nested), command));
+    char broken[] = "{\"cmd\":\"open\"";
+    TEST_ASSERT_NOT_NULL(parseMqttCommand(broken, strlen(broken), command));
+}
+
+void test_mqtt_command_msgpack_and_text(void) {
+    // {"cmd":"open","compartment":"mail","n":1}
+    char payload[] = "\x83\xA3" "cmd" "\xA4" "open" "\xAB" "compartment" "\xA4" "mail" "\xA1" "n" "\x01";
+    MqttCommand command;
+    TEST_ASSERT_NULL(parseMqttCommand(payload, sizeof(payload) - 1, command));
+    TEST_ASSERT_EQUAL(static_cast<int>(PayloadFormat::MSGPACK), static_cast<int>(command.format));
+    TEST_ASSERT_EQUAL(static_cast<int>(MqttCommandAction::OPEN), static_cast<int>(command.action));
+    TEST_ASSERT_TRUE(command.compartment.equals("mail"));
+    TEST_ASSERT_NOT_NULL(parseMqttCommand(payload, sizeof(payload) - 3, command));
+
+    char legacy[] = "OPEN_PARCEL\n";
+    TEST_ASSERT_NULL(parseMqttCommand(legacy, strlen(legacy), command));
+    TEST_ASSERT_EQUAL(static_cast<int>(PayloadFormat::TEXT), static_cast<int>(command.format));
+    TEST_ASSERT_TRUE(command.compartment.equals("parcel"));
+    char unknown[] = "REBOOT";
+    TEST_ASSERT_NOT_NULL(parseMqttCommand(unknown, strlen(unknown), command));
+}
+
+void test_mqtt_command_responses(void) {
+    char payload[] = "{\"cmd\":\"get_state\",\"id\":\"a\\\"b\"}";
+    MqttCommand command;
+    TEST_ASSERT_NULL(parseMqttCommand(payload, strlen(payload), command));
+    char out[96];
+    size_t length = formatMqttResponse(out, sizeof(out), command, nullptr, "LOCKED");
+    TEST_ASSERT_EQUAL_STRING("{\"id\":\"a\\\"b\",\"cmd\":\"get_state\",\"ok\":true,\"state\":\"LOCKED\"}", std::string(out, length).c_str());
+    TEST_ASSERT_EQUAL(0, formatMqttResponse(out, 10, command, nullptr, "LOCKED"));
+
+    char packed[] = "\x81\xA3" "cmd" "\xA9" "calibrate";
+    TEST_ASSERT_NULL(parseMqttCommand(packed, sizeof(packed) - 1, command));
+    length = formatMqttResponse(out, sizeof(out), command, "busy", nullptr);
+    const char expected[] = "\x83\xA3" "cmd" "\xA9" "calibrate" "\xA2" "ok" "\xC2" "\xA5" "error" "\xA4" "busy";
+    TEST_ASSERT_EQUAL(sizeof(expected) - 1, length);
+    TEST_ASSERT_EQUAL_MEMORY(expected, out, length);
+}
+
+int main(int argc, char **argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_mqtt_command_json_in_place);
+    RUN_TEST(test_mqtt_command_msgpack_and_text);
+    RUN_TEST(test_mqtt_command_responses);
+    UNITY_END();
+    return 0;
+}
@@ -0,0 +1,177 @@
+#include <unity.h>
+#include "MqttSession.h"
+#include <deque>
+#include <string>
+#include <cstring>
+
+void setUp(void) {
+    // set stuff up here
+}
+
+void tearDown(void) {
+    // clean stuff up here
+}
+
+// Broker that accepts or refuses connects and publishes as told
+class FakeMqttLink : public MqttLink {
+public:
+    bool up = true;
+    bool accept = true;
+    bool connected = false;
+    int attempts = 0;
+    uint32_t retryInMs = 0;
+    std::string log;
+
+    bool networkUp() override { return up; }
+    void beginConnect() override { attempts++; }
+    int connectResult() override { return accept ? 1 : -1; }
+    bool handshake() override { connected = accept; return connected; }
+    bool loop() override { return connected; }
+    bool publish(const char* topic, const uint8_t* payload, size_t length) override {
+        (void)topic;
+        if (!connected || !accept) {
+            return false;
+        }
+        log.append(reinterpret_cast<const char*>(payload), length);
+        return true;
+    }
+    void close() override { connected = false; }
+    void onAttemptFailed(uint16_t failures, uint32_t retryMs) override { (void)failures; retryInMs = retryMs; }
+};
+
+class FakeMqttSpool : public MqttSpool {
+public:
+    bool append(uint8_t kind, const char* data, size_t length) override {
+        MqttOutbox::Message message;
+        message.kind = kind;
+        message.length = static_cast<uint16_t>(length);
+        memcpy(message.data, data, length);
+        messages.push_back(message);
+        return true;
+    }
+    bool peek(MqttOutbox::Message& out) override {
+        if (messages.empty()) {
+            return false;
+        }
+        out = messages.front();
+        return true;
+    }
+    void consume() override { messages.pop_front(); }
+    bool empty() const override { return messages.empty(); }
+
+    std::deque<MqttOutbox::Message> messages;
+};
+
+void test_mqtt_session_backs_off_and_reconnects(void) {
+    MqttOutbox outbox(OverflowPolicy::DROP_OLDEST);
+    FakeMqttLink link;
+    MqttSession session(outbox, link);
+    session.update(0, 0);
+    TEST_ASSERT_EQUAL(0, link.attempts);
+
+    session.reset(true, 0);
+    link.up = false;
+    session.update(0, 0);
+    TEST_ASSERT_EQUAL(0, link.attempts);
+
+    // Refused twice: 2000 ms -20 % jitter, then twice that
+    link.up = true;
+    link.accept = false;
+    session.update(0, 0);
+    session.update(0, 0);
+    TEST_ASSERT_EQUAL(static_cast<int>(MqttState::WAITING), static_cast<int>(session.state()));
+    session.update(1599, 0);
+    TEST_ASSERT_EQUAL(1, link.attempts);
+    session.update(1600, 0);
+    session.update(1600, 0);
+    TEST_ASSERT_EQUAL(2, link.attempts);
+    session.update(4799, 0);
+    TEST_ASSERT_EQUAL(2, link.attempts);
+
+    link.accept = true;
+    session.update(4800, 0);
+    session.update(4850, 0);
+    TEST_ASSERT_EQUAL(static_cast<int>(MqttState::CONNECTED), static_cast<int>(session.state()));
+    TEST_ASSERT_EQUAL(1, session.connects());
+    TEST_ASSERT_EQUAL(2, session.connectFailures());
+    TEST_ASSERT_EQUAL(50, session.lastConnectMs());
+
+    // A lost connection is retried at once, with the backoff starting over
+    link.connected = false;
+    session.update(5000, 0);
+    session.update(5000, 0);
+    session.update(5000, 0);
+    TEST_ASSERT_EQUAL(static_cast<int>(MqttState::CONNECTED), static_cast<int>(session.state()));
+    TEST_ASSERT_EQUAL(4, link.attempts);
+}
+
+void test_mqtt_session_retry_delay_is_capped(void) {
+    MqttOutbox outbox(OverflowPolicy::DROP_OLDEST);
+    FakeMqttLink link;
+    MqttSession session(outbox, link);
+    session.reset(true, 0);
+    link.accept = false;
+
+    // 2 s doubling up to 5 min, each -20 % with no randomness
+    const uint32_t expected[] = { 1600, 3200, 6400, 12800, 25600, 51200, 102400, 204800, 240000, 240000 };
+    uint32_t now = 0;
+    for (uint32_t delay : expected) {
+        session.update(now, 0);
+        session.update(now, 0);
+        TEST_ASSERT_EQUAL_UINT32(delay, link.retryInMs);
+        session.update(now + delay - 1, 0);
+        TEST_ASSERT_EQUAL(static_cast<int>(MqttState::WAITING), static_cast<int>(session.state()));
+        now += delay;
+    }
+    TEST_ASSERT_EQUAL(10, link.attempts);
+
+    // Full jitter stays within +20 % of the cap
+    session.update(now, 120000);
+    session.update(now, 120000);
+    TEST_ASSERT_EQUAL_UINT32(360000, link.retryInMs);
+}
+
+void test_mqtt_session_spools_and_replays_in_order(void) {
+    MqttOutbox outbox(OverflowPolicy::DROP_OLDEST);
+    FakeMqttLink link;
+    FakeMqttSpool spool;
+    MqttSession session(outbox, link, &spool);
+    session.reset(true, 0);
+    link.up = false;
+
+    const char* words[] = { "a", "b", "c", "d", "e", "f", "g" };
+    for (const char* word : words) {
+        outbox.push(MQTT_TOPIC_STATE, word, 1);
+    }
+    session.update(0, 0);
+    TEST_ASSERT_EQUAL(7, spool.messages.size());
+    TEST_ASSERT_EQUAL(0, outbox.size());
+
+    // Connected: new messages queue up behind the spooled ones
+    link.up = true;
+    session.update(100, 0);
+    session.update(100, 0);
+    outbox.push(MQTT_TOPIC_STATE, "h", 1);
+    session.update(200, 0);
+    TEST_ASSERT_EQUAL_STRING("abcde", link.log.c_str());
+    session.update(250, 0);
+    TEST_ASSERT_EQUAL_STRING("abcde", link.log.c_str());
+    session.update(300, 0);
+    TEST_ASSERT_EQUAL_STRING("abcdefgh", link.log.c_str());
+    TEST_ASSERT_EQUAL(8, session.replayed());
+
+    outbox.push(MQTT_TOPIC_RESPONSE, "i", 1);
+    session.update(310, 0);
+    TEST_ASSERT_EQUAL_STRING("abcdefghi", link.log.c_str());
+    TEST_ASSERT_EQUAL(9, session.published());
+    TEST_ASSERT_EQUAL(0, session.lost());
+}
+
+int main(int argc, char **argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_mqtt_session_backs_off_and_reconnects);
+    RUN_TEST(test_mqtt_session_retry_delay_is_capped);
+    RUN_TEST(test_mqtt_session_spools_and_replays_in_order);
+    UNITY_END();
+    return 0;
+}
@@ -0,0 +1,64 @@
+#include <unity.h>
+#include "WebhookTemplate.h"
+#include <cstring>
+#include <string>
+
+void setUp(void) {
+    // set stuff up here
+}
+
+void tearDown(void) {
+    // clean stuff up here
+}
+
+static WebhookEvent makeEvent(const char* type, const char* compartment, const char* source, const char* label, uint32_t at) {
+    WebhookEvent event = {};
+    strncpy(event.type, type, sizeof(event.type) - 1);
+    strncpy(event.compartment, compartment, sizeof(event.compartment) - 1);
+    strncpy(event.requester, label[0] ? label : source, sizeof(event.requester) - 1);
+    strncpy(event.label, label, sizeof(event.label) - 1);
+    strncpy(event.source, source, sizeof(event.source) - 1);
+    event.at = at;
+    return event;
+}
+
+void test_webhook_template_url_placeholders(void) {
+    WebhookEvent event = makeEvent("open", "parcel", "wiegand", "DHL Bote", 1200);
+
+    std::string url = renderWebhookTemplate("https://ha.local/hook?c={compartment}&by={requester}&x={unknown}", &event, 1, TemplateEscape::URL);
+    TEST_ASSERT_EQUAL_STRING("https://ha.local/hook?c=parcel&by=DHL%20Bote&x={unknown}", url.c_str());
+
+    WebhookEvent remote = makeEvent("open", "mail", "mqtt", "", 1300);
+    url = renderWebhookTemplate("/hook?by={requester}&label={label}&source={source}", &remote, 1, TemplateEscape::URL);
+    TEST_ASSERT_EQUAL_STRING("/hook?by=mqtt&label=&source=mqtt", url.c_str());
+    url = renderWebhookTemplate("/hook?label={label}&source={source}", &event, 1, TemplateEscape::URL);
+    TEST_ASSERT_EQUAL_STRING("/hook?label=DHL%20Bote&source=wiegand", url.c_str());
+}
+
+void test_webhook_template_batches_events(void) {
+    WebhookEvent events[] = {
+        makeEvent("open", "mail", "wiegand", "Anna \"A\"", 100),
+        makeEvent("opened", "mail", "wiegand", "Anna \"A\"", 900),
+        makeEvent("locked", "", "webinterface", "", 2500)
+    };
+
+    std::string body = renderWebhookTemplate("{\"n\":{count},\"last\":\"{event}\",\"events\":{events}}", events, 3, TemplateEscape::JSON);
+    TEST_ASSERT_EQUAL_STRING("{\"n\":3,\"last\":\"locked\",\"events\":["
+                             "{\"event\":\"open\",\"compartment\":\"mail\",\"requester\":\"Anna \\\"A\\\"\","
+                             "\"label\":\"Anna \\\"A\\\"\",\"source\":\"wiegand\",\"time\":100},"
+                             "{\"event\":\"opened\",\"compartment\":\"mail\",\"requester\":\"Anna \\\"A\\\"\","
+                             "\"label\":\"Anna \\\"A\\\"\",\"source\":\"wiegand\",\"time\":900},"
+                             "{\"event\":\"locked\",\"compartment\":\"\",\"requester\":\"webinterface\","
+                             "\"label\":\"\",\"source\":\"webinterface\",\"time\":2500}]}",
+                             body.c_str());
+    TEST_ASSERT_EQUAL(WEBHOOK_OPENED, webhookEventBit("opened"));
+    TEST_ASSERT_EQUAL(0, webhookEventBit("closed"));
+}
+
+int main(int argc, char **argv) {
+    UNITY_BEGIN();
+    RUN_TEST(test_webhook_template_url_placeholders);
+    RUN_TEST(test_webhook_template_batches_events);
+    UNITY_END();
+    return 0;
+}